@@ -0,0 +1,18 @@
+TEMPLATE = app
+TARGET = flythrough
+DEPENDPATH += . ../..
+INCLUDEPATH += . ../..
+
+QT += webkit script
+
+contains(QT_CONFIG, opengl):{
+QT += opengl
+unix:!mac:!contains(QT_CONFIG, opengles2) LIBS += -lGLEW
+unix:!mac:!contains(QT_CONFIG, opengles2) DEFINES += USE_GL_RENDERER
+}
+
+HEADERS += entity.h mazescene.h scriptwidget.h spanbuffer.h tilemap.h mapfile.h frameprofiler.h tracerecorder.h glrenderer.h columnrenderer.h floorrenderer.h lightgrid.h visibilitypolygon.h simulation.h framedriver.h fieldofview.h
+SOURCES += main.cpp entity.cpp mazescene.cpp scriptwidget.cpp spanbuffer.cpp tilemap.cpp mapfile.cpp frameprofiler.cpp tracerecorder.cpp glrenderer.cpp columnrenderer.cpp floorrenderer.cpp lightgrid.cpp visibilitypolygon.cpp simulation.cpp framedriver.cpp fieldofview.cpp
+
+HEADERS += modelitem.h model.h
+SOURCES += model.cpp modelitem.cpp
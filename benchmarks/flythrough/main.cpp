@@ -0,0 +1,387 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include <QtGui>
+
+#include <math.h>
+#include <stdio.h>
+
+#include "mazescene.h"
+#include "mapfile.h"
+#include "tracerecorder.h"
+
+// Renders the maze offscreen while moving the camera along a path, and
+// reports frame time percentiles for each part of a frame.
+//
+// usage: flythrough [--map file] [--path file] [--save-path file]
+//                   [--frames N] [--size WxH] [--seed N] [--raycast]
+//                   [--software] [--trace file]
+//
+// A path file has one "x y yaw" line per frame. Without --path a random
+// walk through the open cells of the map is generated.
+
+static const int frameInterval = 16;
+
+struct PathPoint
+{
+    QPointF pos;
+    qreal yaw;
+};
+
+static QVector<PathPoint> loadPath(const QString &fileName)
+{
+    QVector<PathPoint> path;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return path;
+
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QTextStream ts(&line, QIODevice::ReadOnly);
+        qreal x, y, yaw;
+        ts >> x >> y >> yaw;
+        if (ts.status() == QTextStream::Ok) {
+            PathPoint point = { QPointF(x, y), yaw };
+            path << point;
+        }
+    }
+
+    return path;
+}
+
+static bool savePath(const QString &fileName, const QVector<PathPoint> &path)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    QTextStream out(&file);
+    out << "# x y yaw, one line per " << frameInterval << " ms frame\n";
+    foreach (const PathPoint &point, path)
+        out << point.pos.x() << ' ' << point.pos.y() << ' ' << point.yaw << '\n';
+
+    return file.error() == QFile::NoError;
+}
+
+static qreal angleDelta(qreal from, qreal to)
+{
+    qreal delta = fmod(to - from, 360);
+    if (delta > 180)
+        delta -= 360;
+    else if (delta < -180)
+        delta += 360;
+    return delta;
+}
+
+// random walk between the centers of open cells, turning smoothly towards
+// the direction of travel
+static QVector<PathPoint> generatePath(const TileMap &map, const QPointF &start, qreal startYaw,
+                                       int frames, uint seed)
+{
+    QVector<PathPoint> path;
+
+    qsrand(seed);
+
+    const qreal speed = 2.0 * frameInterval / 1000; // cells per frame
+    const int dx[] = { 0, 0, -1, 1 };
+    const int dy[] = { -1, 1, 0, 0 };
+
+    int x = int(start.x());
+    int y = int(start.y());
+    QPointF pos = start;
+    qreal yaw = startYaw;
+    int lastDirection = -1;
+
+    QPointF target = pos;
+    while (path.size() < frames) {
+        if (QLineF(pos, target).length() < speed) {
+            pos = target;
+
+            int directions[4];
+            int count = 0;
+            for (int i = 0; i < 4; ++i) {
+                if (map.type(x + dx[i], y + dy[i]) == TileMap::Empty
+                    && (lastDirection < 0 || i != TileMap::opposite(lastDirection)))
+                {
+                    directions[count++] = i;
+                }
+            }
+
+            // only turn back at dead ends
+            if (!count && lastDirection >= 0) {
+                const int back = TileMap::opposite(lastDirection);
+                if (map.type(x + dx[back], y + dy[back]) == TileMap::Empty)
+                    directions[count++] = back;
+            }
+
+            if (!count) {
+                // nowhere to go, look around
+                PathPoint point = { pos, yaw };
+                path << point;
+                yaw += 2;
+                continue;
+            }
+
+            lastDirection = directions[qrand() % count];
+            x += dx[lastDirection];
+            y += dy[lastDirection];
+            target = QPointF(x + 0.5, y + 0.5);
+        }
+
+        const QLineF step(pos, target);
+        pos = step.pointAt(speed / step.length());
+
+        const qreal targetYaw = step.angle() + 90;
+        yaw += qBound(qreal(-6), angleDelta(yaw, targetYaw), qreal(6));
+
+        PathPoint point = { pos, yaw };
+        path << point;
+    }
+
+    return path;
+}
+
+struct Timings
+{
+    const char *name;
+    QVector<qint64> samples;
+};
+
+static void report(const Timings &timings)
+{
+    QVector<qint64> samples = timings.samples;
+    if (samples.isEmpty())
+        return;
+
+    qSort(samples);
+
+    qint64 total = 0;
+    foreach (qint64 sample, samples)
+        total += sample;
+
+    const int n = samples.size();
+    printf("%-18s %9.3f %9.3f %9.3f %9.3f %9.3f\n", timings.name,
+           total / 1e6 / n,
+           samples.at(n / 2) / 1e6,
+           samples.at(qMin(n - 1, n * 90 / 100)) / 1e6,
+           samples.at(qMin(n - 1, n * 99 / 100)) / 1e6,
+           samples.last() / 1e6);
+}
+
+static bool findDataDir(const QString &appDir)
+{
+    const QStringList candidates = QStringList()
+        << QDir::currentPath() << appDir << appDir + "/../.." << appDir + "/../../..";
+
+    foreach (const QString &dir, candidates) {
+        if (QFile::exists(dir + "/floor.png")) {
+            QDir::setCurrent(dir);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    QApplication::setGraphicsSystem("raster");
+    QApplication app(argc, argv);
+
+    QString mapFileName;
+    QString pathFileName;
+    QString savePathFileName;
+    QString traceFileName;
+    int frames = 1000;
+    QSize size(800, 600);
+    uint seed = 1;
+    bool raycast = false;
+    bool software = false;
+
+    const QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); ++i) {
+        const QString arg = args.at(i);
+        const bool hasValue = i + 1 < args.size();
+        if (arg == QLatin1String("--map") && hasValue) {
+            mapFileName = args.at(++i);
+        } else if (arg == QLatin1String("--path") && hasValue) {
+            pathFileName = args.at(++i);
+        } else if (arg == QLatin1String("--save-path") && hasValue) {
+            savePathFileName = args.at(++i);
+        } else if (arg == QLatin1String("--frames") && hasValue) {
+            frames = qMax(1, args.at(++i).toInt());
+        } else if (arg == QLatin1String("--seed") && hasValue) {
+            seed = args.at(++i).toUInt();
+        } else if (arg == QLatin1String("--size") && hasValue) {
+            const QStringList parts = args.at(++i).split('x');
+            if (parts.size() == 2)
+                size = QSize(parts.at(0).toInt(), parts.at(1).toInt()).expandedTo(QSize(64, 48));
+        } else if (arg == QLatin1String("--trace") && hasValue) {
+            traceFileName = args.at(++i);
+        } else if (arg == QLatin1String("--raycast")) {
+            raycast = true;
+        } else if (arg == QLatin1String("--software")) {
+            software = true;
+        } else {
+            qWarning() << "Unknown argument" << arg;
+            return 1;
+        }
+    }
+
+    // resolve file arguments before switching to the directory with the textures
+    if (!mapFileName.isEmpty())
+        mapFileName = QFileInfo(mapFileName).absoluteFilePath();
+    if (!pathFileName.isEmpty())
+        pathFileName = QFileInfo(pathFileName).absoluteFilePath();
+    if (!savePathFileName.isEmpty())
+        savePathFileName = QFileInfo(savePathFileName).absoluteFilePath();
+    if (!traceFileName.isEmpty())
+        traceFileName = QFileInfo(traceFileName).absoluteFilePath();
+
+    if (!findDataDir(app.applicationDirPath()))
+        qWarning() << "Textures not found, run from the wolfenqt directory";
+
+    MazeScene *scene = 0;
+    if (!mapFileName.isEmpty()) {
+        scene = MazeScene::load(mapFileName);
+        if (!scene)
+            return 1;
+    } else {
+        const char *map =
+            "###&?#.#"
+            "#      #"
+            "=      &"
+            "#      #"
+            "# /### #"
+            "&    # #"
+            "* @@   &"
+            "# @@ # #"
+            "#      #"
+            "###&%-##"
+            "$      !"
+            "#&&&&&&#";
+
+        QVector<Light> lights;
+        lights << Light(QPointF(3.5, 2.5), 1)
+               << Light(QPointF(3.5, 6.5), 1)
+               << Light(QPointF(1.5, 10.5), 0.3);
+
+        scene = new MazeScene(lights, TileMap(map, 8, 12));
+    }
+
+    if (raycast)
+        scene->setVisibilityMode(MazeScene::RaycastVisibility);
+    scene->setSoftwareRendering(software);
+
+    QVector<PathPoint> path;
+    if (!pathFileName.isEmpty()) {
+        path = loadPath(pathFileName);
+        if (path.isEmpty()) {
+            qWarning() << "No path in" << pathFileName;
+            return 1;
+        }
+    } else {
+        path = generatePath(scene->map(), scene->camera().pos(), scene->camera().yaw(),
+                            frames, seed);
+    }
+
+    if (!savePathFileName.isEmpty() && !savePath(savePathFileName, path)) {
+        qWarning() << "Failed to save path" << savePathFileName;
+        return 1;
+    }
+
+    View view;
+    view.setAttribute(Qt::WA_DontShowOnScreen);
+    view.setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    view.setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    view.setFrameStyle(QFrame::NoFrame);
+    view.resize(size);
+    view.setScene(scene);
+    view.show();
+
+    // deliver the resize without running the scene's frame driver
+    QApplication::sendPostedEvents();
+
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+
+    Timings move = { "move()", QVector<qint64>() };
+    Timings transforms = { "updateTransforms()", QVector<qint64>() };
+    Timings paint = { "paint", QVector<qint64>() };
+    Timings frame = { "frame", QVector<qint64>() };
+
+    if (!traceFileName.isEmpty())
+        TraceRecorder::instance()->start(traceFileName);
+
+    QElapsedTimer timer;
+    for (int i = 0; i < path.size(); ++i) {
+        Camera camera = scene->camera();
+        camera.setPos(path.at(i).pos);
+        camera.setYaw(path.at(i).yaw);
+        scene->setCamera(camera);
+
+        timer.start();
+        scene->simulate((i + 1) * frameInterval);
+        const qint64 t0 = timer.nsecsElapsed();
+        scene->updateTransforms();
+        const qint64 t1 = timer.nsecsElapsed();
+        {
+            QPainter painter(&image);
+            view.render(&painter);
+        }
+        const qint64 t2 = timer.nsecsElapsed();
+
+        move.samples << t0;
+        transforms.samples << t1 - t0;
+        paint.samples << t2 - t1;
+        frame.samples << t2;
+    }
+
+    TraceRecorder::instance()->stop();
+
+    printf("%d frames at %dx%d, %s visibility, %s rendering\n", path.size(), size.width(), size.height(),
+           raycast ? "raycast" : "span", software ? "column" : "item");
+    printf("%-18s %9s %9s %9s %9s %9s\n", "ms", "mean", "p50", "p90", "p99", "max");
+    report(move);
+    report(transforms);
+    report(paint);
+    report(frame);
+
+    delete scene;
+    return 0;
+}
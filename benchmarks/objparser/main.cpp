@@ -0,0 +1,207 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include <QtCore>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "model.h"
+
+// Compares the memory mapped OBJ parser against the QTextStream based one and
+// the binary mesh cache, on qt.obj and on a generated mesh, and checks they
+// produce the same data.
+//
+// usage: objparser [file.obj ...] [--grid N] [--runs N]
+
+static QString writeSyntheticMesh(const QString &dirPath, int n)
+{
+    const QString fileName = dirPath + QLatin1String("/synthetic.obj");
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return QString();
+
+    QTextStream out(&file);
+    out << "# " << n << "x" << n << " height field\n";
+
+    for (int y = 0; y <= n; ++y) {
+        for (int x = 0; x <= n; ++x) {
+            const double h = 0.25 * qSin(x * 0.05) * qCos(y * 0.07);
+            out << "v " << QString::number(x * 0.01, 'f', 6)
+                << ' ' << QString::number(h, 'g', 9)
+                << ' ' << QString::number(y * 0.01, 'f', 6) << '\n';
+        }
+    }
+
+    // alternate between quads and triangle pairs, and between plain, texture
+    // and relative vertex references
+    for (int y = 0; y < n; ++y) {
+        for (int x = 0; x < n; ++x) {
+            const int a = y * (n + 1) + x + 1;
+            const int b = a + 1;
+            const int c = a + n + 2;
+            const int d = a + n + 1;
+
+            switch ((x + y) % 3) {
+            case 0:
+                out << "f " << a << ' ' << b << ' ' << c << ' ' << d << '\n';
+                break;
+            case 1:
+                out << "f " << a << "/1/1 " << b << "/2/1 " << c << "/3/1\r\n";
+                out << "f " << a << "//1 " << c << "//1 " << d << "//1\r\n";
+                break;
+            default:
+                out << "fo " << a << ' ' << b << ' ' << c << '\n';
+                break;
+            }
+        }
+    }
+
+    return fileName;
+}
+
+template <typename T>
+static bool sameData(const QVector<T> &a, const QVector<T> &b)
+{
+    return a.size() == b.size() && !memcmp(a.constData(), b.constData(), a.size() * sizeof(T));
+}
+
+static bool benchmark(const QString &fileName, int runs)
+{
+    qint64 textTime = 0;
+    qint64 mappedTime = 0;
+    qint64 cachedTime = 0;
+
+    Model text;
+    Model mapped;
+    Model cached;
+
+    for (int i = 0; i < runs; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        text = Model(fileName, Model::TextStreamParser, false);
+        textTime += timer.elapsed();
+
+        timer.start();
+        mapped = Model(fileName, Model::MappedParser, false);
+        mappedTime += timer.elapsed();
+    }
+
+    // the first load writes the cache, the timed ones read it
+    const QString cacheFileName = Model::cacheFileName(fileName);
+    QFile::remove(cacheFileName);
+    const Model writer(fileName, Model::MappedParser, true);
+
+    const bool hasCache = QFile::exists(cacheFileName);
+    for (int i = 0; hasCache && i < runs; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        cached = Model(fileName, Model::MappedParser, true);
+        cachedTime += timer.elapsed();
+    }
+    QFile::remove(cacheFileName);
+
+    const bool identical = sameData(text.vertexData(), mapped.vertexData())
+                           && sameData(text.triangleIndexData(), mapped.triangleIndexData())
+                           && sameData(text.edgeIndexData(), mapped.edgeIndexData())
+                           && (!hasCache || (sameData(mapped.vertexData(), cached.vertexData())
+                                             && sameData(mapped.normalData(), cached.normalData())
+                                             && sameData(mapped.triangleIndexData(), cached.triangleIndexData())
+                                             && sameData(mapped.edgeIndexData(), cached.edgeIndexData())));
+
+    printf("%s: %d vertices, %d triangles\n", qPrintable(QFileInfo(fileName).fileName()),
+           mapped.vertexData().size(), mapped.triangleIndexData().size() / 3);
+    printf("  text stream: %8.1f ms\n", textTime / qreal(runs));
+    printf("  mapped:      %8.1f ms (%.1fx)\n", mappedTime / qreal(runs),
+           mappedTime ? textTime / qreal(mappedTime) : 0.0);
+    if (hasCache)
+        printf("  mesh cache:  %8.1f ms (%.1fx)\n", cachedTime / qreal(runs),
+               cachedTime ? textTime / qreal(cachedTime) : 0.0);
+    else
+        printf("  mesh cache:  not written\n");
+    printf("  output %s\n", identical ? "identical" : "DIFFERS");
+
+    return identical;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList files;
+    int gridSize = 1000;
+    int runs = 3;
+
+    const QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); ++i) {
+        if (args.at(i) == QLatin1String("--grid") && i + 1 < args.size())
+            gridSize = args.at(++i).toInt();
+        else if (args.at(i) == QLatin1String("--runs") && i + 1 < args.size())
+            runs = qMax(1, args.at(++i).toInt());
+        else
+            files << args.at(i);
+    }
+
+    if (files.isEmpty()) {
+        const QString qtObj = QDir(app.applicationDirPath()).filePath("../../qt.obj");
+        files << (QFile::exists(qtObj) ? qtObj : QString("qt.obj"));
+    }
+
+    const QString dirPath = QDir::tempPath() + QString("/objparser-%1").arg(app.applicationPid());
+    QDir().mkpath(dirPath);
+
+    QString synthetic;
+    if (gridSize > 0) {
+        synthetic = writeSyntheticMesh(dirPath, gridSize);
+        if (!synthetic.isEmpty())
+            files << synthetic;
+    }
+
+    bool ok = true;
+    foreach (const QString &fileName, files) {
+        if (!QFile::exists(fileName)) {
+            qWarning() << "No such file" << fileName;
+            ok = false;
+            continue;
+        }
+        ok &= benchmark(fileName, runs);
+    }
+
+    if (!synthetic.isEmpty())
+        QFile::remove(synthetic);
+    QDir().rmdir(dirPath);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,12 @@
+TEMPLATE = app
+TARGET = objparser
+DEPENDPATH += . ../..
+INCLUDEPATH += . ../..
+
+contains(QT_CONFIG, opengl):{
+QT += opengl
+unix:!mac:!contains(QT_CONFIG, opengles2) LIBS += -lGLEW
+}
+
+HEADERS += model.h
+SOURCES += main.cpp model.cpp
@@ -0,0 +1,351 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include "columnrenderer.h"
+
+#include <QPainter>
+#include <QVarLengthArray>
+#include <qmath.h>
+
+#ifndef QT_NO_CONCURRENT
+#include <QtConcurrentMap>
+#endif
+
+#include "mazescene.h"
+#include "tracerecorder.h"
+
+QMatrix4x4 fromRotation(float angle, Qt::Axis axis);
+QMatrix4x4 fromProjection(float fovAngle);
+
+// columns per task, wide enough that two threads don't share cache lines
+static const int blockSize = 32;
+
+// shadow alpha of the see-through walls, see the WallItem constructor
+static const int translucentShadow = 100;
+
+static const qreal noWall = 1e30;
+
+struct ColumnBlockRenderer
+{
+    typedef void result_type;
+
+    ColumnBlockRenderer(ColumnRenderer *renderer) : renderer(renderer) {}
+    void operator()(int first) const { renderer->renderColumns(first, first + blockSize); }
+
+    ColumnRenderer *renderer;
+};
+
+static inline uint darken(uint pixel, int alpha)
+{
+    const uint s = 255 - alpha;
+    const uint rb = (((pixel & 0xff00ff) * s) >> 8) & 0xff00ff;
+    const uint g = (((pixel & 0x00ff00) * s) >> 8) & 0x00ff00;
+    return 0xff000000 | rb | g;
+}
+
+static inline int wrap(int value, int size)
+{
+    value %= size;
+    return value < 0 ? value + size : value;
+}
+
+ColumnRenderer::ColumnRenderer(const MazeScene *scene)
+    : m_scene(scene)
+    , m_floor(QImage("floor.png").convertToFormat(QImage::Format_RGB32))
+    , m_ceiling(QImage("ceiling.png").convertToFormat(QImage::Format_RGB32))
+    , m_bits(0)
+    , m_stride(0)
+    , m_focalLength(1)
+    , m_horizon(0)
+    , m_eyeHeight(0)
+    , m_columnScale(1)
+    , m_columnOffset(0)
+    , m_rowScale(1)
+    , m_rowOffset(0)
+{
+    if (m_floor.isNull())
+        m_floor = QImage(1, 1, QImage::Format_RGB32);
+    if (m_ceiling.isNull())
+        m_ceiling = QImage(1, 1, QImage::Format_RGB32);
+}
+
+// where the ray hits the visible part of the face, t is the ray parameter
+// and s goes from b to a along the face
+bool ColumnRenderer::intersect(const WallItem *face, const QPointF &direction, qreal *t, qreal *s) const
+{
+    const QPointF e = face->a() - face->b();
+    const qreal denominator = direction.x() * e.y() - direction.y() * e.x();
+    if (qFuzzyIsNull(denominator))
+        return false;
+
+    const QPointF w = face->b() - m_origin;
+    *t = (w.x() * e.y() - w.y() * e.x()) / denominator;
+    *s = (w.x() * direction.y() - w.y() * direction.x()) / denominator;
+    if (*t <= 0 || *s < 0 || *s > 1)
+        return false;
+
+    // doors slide by shrinking the target rect from the left
+    const QRectF bounds = face->boundingRect();
+    return bounds.left() + *s * bounds.width() >= face->targetRect().left();
+}
+
+// device rows covered by a wall at the given depth, [first, last)
+void ColumnRenderer::wallRows(qreal depth, int *first, int *last, qreal *top, qreal *bottom) const
+{
+    const int height = m_image.height();
+    *top = (m_focalLength * (m_eyeHeight - 0.5) / depth + m_horizon - m_rowOffset) / m_rowScale;
+    *bottom = (m_focalLength * (m_eyeHeight + 0.5) / depth + m_horizon - m_rowOffset) / m_rowScale;
+    *first = qBound(0, qCeil(*top - 0.5), height);
+    *last = qBound(0, qCeil(*bottom - 0.5), height);
+}
+
+void ColumnRenderer::renderColumn(int column)
+{
+    const TileMap &map = m_scene->map();
+    const int height = m_image.height();
+
+    const qreal sx = m_columnScale * (column + 0.5) + m_columnOffset;
+    const QPointF direction = m_forward + m_right * (sx / m_focalLength);
+
+    // find the nearest face with a texture, remembering the see-through
+    // ones in front of it
+    const WallItem *hit = 0;
+    qreal depth = noWall;
+    qreal hitS = 0;
+    QVarLengthArray<qreal, 8> translucent;
+
+    GridRay ray(m_origin, direction);
+    while (!hit && map.contains(ray.x(), ray.y())) {
+        const int x = ray.x();
+        const int y = ray.y();
+
+        ray.next();
+
+        WallItem *faces[2];
+        const int count = m_scene->crossedFaces(x, y, ray.x(), ray.y(), ray.side(), faces);
+        for (int i = 0; i < count; ++i) {
+            qreal t;
+            qreal s;
+            if (!intersect(faces[i], direction, &t, &s))
+                continue;
+
+            if (faces[i]->type() == 2) {
+                translucent.append(t);
+            } else if (t < depth) {
+                hit = faces[i];
+                depth = t;
+                hitS = s;
+            }
+        }
+    }
+
+    m_depths[column] = depth;
+    m_hits[column] = hit;
+
+    uint *dst = m_bits + column;
+
+    int first = qBound(0, qCeil((m_horizon - m_rowOffset) / m_rowScale - 0.5), height);
+    int last = first;
+
+    if (hit) {
+        qreal top;
+        qreal bottom;
+        wallRows(depth, &first, &last, &top, &bottom);
+
+        const QImage &image = hit->image();
+        const QRectF bounds = hit->boundingRect();
+        const qreal lx = bounds.left() + hitS * bounds.width();
+        const int u = qBound(0, int((lx - hit->targetRect().left()) / bounds.width() * image.width()),
+                             image.width() - 1);
+
+        const uint *texels = reinterpret_cast<const uint *>(image.constBits()) + u;
+        const int texelStride = image.bytesPerLine() / 4;
+        const int imageHeight = image.height();
+
+        // the lighting is baked into the wall images
+        const qreal step = imageHeight / (bottom - top);
+        qreal v = (first + 0.5 - top) * step;
+        for (int y = first; y < last; ++y, v += step) {
+            const int row = qBound(0, int(v), imageHeight - 1);
+            dst[y * m_stride] = texels[row * texelStride];
+        }
+    }
+
+    // the floor and ceiling are unlit, like in MazeScene::drawBackground()
+    const qreal ceilingHeight = m_focalLength * (m_eyeHeight - 0.5);
+    const uint *ceiling = reinterpret_cast<const uint *>(m_ceiling.constBits());
+    const int ceilingStride = m_ceiling.bytesPerLine() / 4;
+    for (int y = 0; y < first; ++y) {
+        const qreal dy = m_rowScale * (y + 0.5) + m_rowOffset - m_horizon;
+        if (dy >= 0) {
+            dst[y * m_stride] = 0xff000000;
+            continue;
+        }
+
+        const QPointF pos = m_origin + direction * (ceilingHeight / dy);
+        const int u = wrap(qFloor(pos.x() * 2 * m_ceiling.width()), m_ceiling.width());
+        const int v = wrap(qFloor(pos.y() * 2 * m_ceiling.height()), m_ceiling.height());
+        dst[y * m_stride] = ceiling[v * ceilingStride + u];
+    }
+
+    const qreal floorHeight = m_focalLength * (m_eyeHeight + 0.5);
+    const uint *floor = reinterpret_cast<const uint *>(m_floor.constBits());
+    const int floorStride = m_floor.bytesPerLine() / 4;
+    for (int y = last; y < height; ++y) {
+        const qreal dy = m_rowScale * (y + 0.5) + m_rowOffset - m_horizon;
+        if (dy <= 0) {
+            dst[y * m_stride] = 0xff000000;
+            continue;
+        }
+
+        const QPointF pos = m_origin + direction * (floorHeight / dy);
+        const int u = wrap(qFloor(pos.x() * 2 * m_floor.width()), m_floor.width());
+        const int v = wrap(qFloor(pos.y() * 2 * m_floor.height()), m_floor.height());
+        dst[y * m_stride] = floor[v * floorStride + u];
+    }
+
+    // see-through walls only darken what is behind them
+    for (int i = 0; i < translucent.size(); ++i) {
+        const qreal t = translucent.at(i);
+        if (t >= depth)
+            continue;
+
+        int from;
+        int to;
+        qreal top;
+        qreal bottom;
+        wallRows(t, &from, &to, &top, &bottom);
+        for (int y = from; y < to; ++y)
+            dst[y * m_stride] = darken(dst[y * m_stride], translucentShadow);
+    }
+}
+
+void ColumnRenderer::renderColumns(int first, int last)
+{
+    last = qMin(last, m_image.width());
+    for (int column = first; column < last; ++column)
+        renderColumn(column);
+}
+
+void ColumnRenderer::render(QPainter *painter, const Camera &camera)
+{
+    TraceScope trace("columnRender", "render");
+
+    const QSize size(painter->device()->width(), painter->device()->height());
+    if (size.isEmpty())
+        return;
+
+    if (m_image.size() != size) {
+        m_image = QImage(size, QImage::Format_RGB32);
+        m_depths.resize(size.width());
+        m_hits.resize(size.width());
+    }
+    m_bits = reinterpret_cast<uint *>(m_image.bits());
+    m_stride = m_image.bytesPerLine() / 4;
+
+    // the view only scales and translates the scene
+    m_deviceTransform = painter->combinedTransform();
+    const QTransform inverse = m_deviceTransform.inverted();
+    m_columnScale = inverse.m11();
+    m_columnOffset = inverse.dx();
+    m_rowScale = inverse.m22();
+    m_rowOffset = inverse.dy();
+
+    // the camera without its pitch, which becomes a shift of the horizon
+    const QMatrix4x4 view = fromRotation(-camera.pitch(), Qt::XAxis) * camera.viewMatrix();
+    const QMatrix4x4 inverseView = view.inverted();
+    const QVector3D forward = inverseView.mapVector(QVector3D(0, 0, -1));
+    const QVector3D right = inverseView.mapVector(QVector3D(1, 0, 0));
+
+    m_origin = camera.pos();
+    m_forward = QPointF(forward.x(), forward.z());
+    m_right = QPointF(right.x(), right.z());
+    m_eyeHeight = view(1, 3);
+    m_focalLength = fromProjection(camera.fov())(0, 0);
+    m_horizon = m_focalLength * qTan(camera.pitch() * M_PI / 180);
+
+    QVector<int> blocks;
+    for (int first = 0; first < size.width(); first += blockSize)
+        blocks << first;
+
+#ifndef QT_NO_CONCURRENT
+    QtConcurrent::blockingMap(blocks, ColumnBlockRenderer(this));
+#else
+    renderColumns(0, size.width());
+#endif
+
+    painter->save();
+    painter->resetTransform();
+    painter->drawImage(0, 0, m_image);
+    painter->restore();
+}
+
+void ColumnRenderer::drawOccluders(QPainter *painter, const QVector<ProjectedItem *> &items)
+{
+    if (m_image.isNull())
+        return;
+
+    painter->save();
+    painter->resetTransform();
+
+    foreach (const ProjectedItem *item, items) {
+        if (item->isBatched() || item->isObscured() || !item->isVisible())
+            continue;
+
+        const QRect rect = m_deviceTransform.mapRect(item->sceneBoundingRect()).toAlignedRect()
+                           & m_image.rect();
+        if (rect.isEmpty())
+            continue;
+
+        const QPointF delta = (item->a() + item->b()) / 2 - m_origin;
+        const qreal depth = delta.x() * m_forward.x() + delta.y() * m_forward.y();
+
+        // copy back runs of columns with a nearer wall, skipping the
+        // columns where the item is the wall that was hit
+        int start = -1;
+        for (int x = rect.left(); x <= rect.right() + 1; ++x) {
+            const bool occluded = x <= rect.right()
+                                  && m_depths.at(x) < depth && m_hits.at(x) != item;
+            if (occluded && start < 0) {
+                start = x;
+            } else if (!occluded && start >= 0) {
+                const QRect run(start, rect.top(), x - start, rect.height());
+                painter->drawImage(run.topLeft(), m_image, run);
+                start = -1;
+            }
+        }
+    }
+
+    painter->restore();
+}
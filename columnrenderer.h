@@ -0,0 +1,108 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#ifndef COLUMNRENDERER_H
+#define COLUMNRENDERER_H
+
+#include <QImage>
+#include <QPointF>
+#include <QTransform>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QPainter;
+QT_END_NAMESPACE
+
+class Camera;
+class MazeScene;
+class ProjectedItem;
+class WallItem;
+
+// Software renderer for the raster path. Casts one ray through the tile
+// grid per screen column and texture maps the wall it hits, and the floor
+// and ceiling above and below, straight into an image. Blocks of columns
+// are rendered in parallel on the global thread pool.
+//
+// Rays are cast in the horizontal plane, so looking up or down shears the
+// image instead of tilting the walls, which is close for the pitch range
+// the camera allows.
+class ColumnRenderer
+{
+public:
+    ColumnRenderer(const MazeScene *scene);
+
+    // renders the camera's view at the size of the painter's device and
+    // draws it, the painter transform maps the scene to the device
+    void render(QPainter *painter, const Camera &camera);
+
+    // QGraphicsView paints the remaining items over the rendered image,
+    // this paints the image back in the columns where a wall is in front
+    void drawOccluders(QPainter *painter, const QVector<ProjectedItem *> &items);
+
+private:
+    friend struct ColumnBlockRenderer;
+
+    void renderColumns(int first, int last);
+    void renderColumn(int column);
+    bool intersect(const WallItem *face, const QPointF &direction, qreal *t, qreal *s) const;
+    void wallRows(qreal depth, int *first, int *last, qreal *top, qreal *bottom) const;
+
+    const MazeScene *m_scene;
+
+    QImage m_floor;
+    QImage m_ceiling;
+
+    QImage m_image;
+    uint *m_bits;
+    int m_stride;
+
+    // nearest wall per column, for drawOccluders()
+    QVector<qreal> m_depths;
+    QVector<const ProjectedItem *> m_hits;
+
+    // set up in render() for the current frame
+    QTransform m_deviceTransform;
+    QPointF m_origin;
+    QPointF m_forward;
+    QPointF m_right;
+    qreal m_focalLength;
+    qreal m_horizon;
+    qreal m_eyeHeight;
+    qreal m_columnScale;
+    qreal m_columnOffset;
+    qreal m_rowScale;
+    qreal m_rowOffset;
+};
+
+#endif
@@ -48,48 +48,76 @@ const QImage toAlpha(const QImage &image)
     return result;
 }
 
-Entity::Entity(const QPointF &pos)
-    : ProjectedItem(QRectF(-0.3, -0.4, 0.6, 0.9), false, false)
+Entity::Entity(const QPointF &pos, qreal angle)
+    : ProjectedItem(QRectF(-0.3, -0.4, 0.6, 0.9), false)
     , m_pos(pos)
-    , m_angle(180)
-    , m_walking(false)
+    , m_angle(angle)
     , m_walked(false)
+    , m_animationIndex(0)
+    , m_walking(false)
     , m_turnVelocity(0)
     , m_useTurnTarget(false)
-    , m_animationIndex(0)
     , m_angleIndex(0)
 {
-    startTimer(300);
+    m_pose = pose();
+    m_previousPose = m_pose;
 }
 
 void Entity::walk()
 {
-    m_walking = true;
+    {
+        QMutexLocker locker(&m_commandLock);
+        m_walking = true;
+    }
+    requestFrame();
 }
 
 void Entity::stop()
 {
-    m_walking = false;
-    m_useTurnTarget = false;
-    m_turnVelocity = 0;
+    {
+        QMutexLocker locker(&m_commandLock);
+        m_walking = false;
+        m_useTurnTarget = false;
+        m_turnVelocity = 0;
+    }
+    requestFrame();
 }
 
 void Entity::turnTowards(qreal x, qreal y)
 {
-    m_turnTarget = QPointF(x, y);
-    m_useTurnTarget = true;
+    {
+        QMutexLocker locker(&m_commandLock);
+        m_turnTarget = QPointF(x, y);
+        m_useTurnTarget = true;
+    }
+    requestFrame();
 }
 
 void Entity::turnLeft()
 {
-    m_useTurnTarget = false;
-    m_turnVelocity = -0.5;
+    {
+        QMutexLocker locker(&m_commandLock);
+        m_useTurnTarget = false;
+        m_turnVelocity = -0.5;
+    }
+    requestFrame();
 }
 
 void Entity::turnRight()
 {
-    m_useTurnTarget = false;
-    m_turnVelocity = 0.5;
+    {
+        QMutexLocker locker(&m_commandLock);
+        m_useTurnTarget = false;
+        m_turnVelocity = 0.5;
+    }
+    requestFrame();
+}
+
+// frames may have stopped while the scene was still
+void Entity::requestFrame()
+{
+    if (MazeScene *mazeScene = qobject_cast<MazeScene *>(scene()))
+        mazeScene->requestFrame();
 }
 
 static QVector<QImage> loadSoldierImages()
@@ -109,13 +137,13 @@ static inline int mod(int x, int y)
 
 void Entity::updateTransform(const Camera &camera)
 {
-    qreal angleToCamera = QLineF(m_pos, camera.pos()).angle();
+    qreal angleToCamera = QLineF(m_pose.pos, camera.pos()).angle();
     int cameraAngleIndex = mod(qRound(angleToCamera + 22.5), 360) / 45;
 
-    m_angleIndex = mod(qRound(cameraAngleIndex * 45 - m_angle + 22.5), 360) / 45;
+    m_angleIndex = mod(qRound(cameraAngleIndex * 45 - m_pose.angle + 22.5), 360) / 45;
 
     QPointF delta = QLineF::fromPolar(1, 270.1 + 45 * cameraAngleIndex).p2();
-    setPosition(m_pos - delta, m_pos + delta);
+    setPosition(m_pose.pos - delta, m_pose.pos + delta);
 
     updateImage();
     ProjectedItem::updateTransform(camera);
@@ -123,6 +151,8 @@ void Entity::updateTransform(const Camera &camera)
 
 bool Entity::move(MazeScene *scene)
 {
+    QMutexLocker locker(&m_commandLock);
+
     bool moved = false;
     if (m_useTurnTarget) {
         qreal angleToTarget = QLineF::fromPolar(1, m_angle)
@@ -155,17 +185,39 @@ bool Entity::move(MazeScene *scene)
     return moved;
 }
 
-void Entity::timerEvent(QTimerEvent *)
+void Entity::advanceAnimation(int frames)
 {
-    ++m_animationIndex;
-    updateImage();
+    m_animationIndex += frames;
+}
+
+EntityPose Entity::pose() const
+{
+    EntityPose pose;
+    pose.pos = m_pos;
+    pose.angle = m_angle;
+    pose.walked = m_walked;
+    pose.animationIndex = m_animationIndex;
+    return pose;
+}
+
+bool Entity::setPose(const EntityPose &pose)
+{
+    const bool moved = pose.pos != m_pose.pos || pose.angle != m_pose.angle;
+    const bool frameChanged = pose.walked != m_pose.walked
+                              || pose.animationIndex != m_pose.animationIndex;
+    m_pose = pose;
+
+    // hidden entities pick up the current frame in updateTransform()
+    if (frameChanged && !isObscured())
+        updateImage();
+    return moved;
 }
 
 void Entity::updateImage()
 {
     static QVector<QImage> images = loadSoldierImages();
-    if (m_walked)
-        setImage(images.at(8 + 8 * (m_animationIndex % 4) + m_angleIndex));
+    if (m_pose.walked)
+        setImage(images.at(8 + 8 * (m_pose.animationIndex % 4) + m_angleIndex));
     else
         setImage(images.at(m_angleIndex));
 }
@@ -35,21 +35,33 @@ POSSIBILITY OF SUCH DAMAGE."
 #ifndef ENTITY_H
 #define ENTITY_H
 
+#include <QMutex>
 #include <QPointF>
 #include <QObject>
 
 #include "mazescene.h"
+#include "simulation.h"
 
 class Entity : public QObject, public ProjectedItem
 {
     Q_OBJECT
 public:
-    Entity(const QPointF &pos);
+    Entity(const QPointF &pos, qreal angle = 180);
     void updateTransform(const Camera &camera);
 
-    QPointF pos() const { return m_pos; }
+    // where the item is drawn, safe to read on the GUI thread
+    QPointF drawnPos() const { return m_pose.pos; }
 
     bool move(MazeScene *scene);
+    void advanceAnimation(int frames);
+    EntityPose pose() const;
+
+    // keeps the current pose as the one to interpolate from
+    void savePose() { m_previousPose = pose(); }
+    EntityPose previousPose() const { return m_previousPose; }
+
+    // sets the pose the item is drawn with, returns true if it moved
+    bool setPose(const EntityPose &pose);
 
 public slots:
     void turnTowards(qreal x, qreal y);
@@ -58,24 +70,32 @@ public slots:
     void walk();
     void stop();
 
-protected:
-    void timerEvent(QTimerEvent *event);
-
 private:
+    friend class MazeScene;
+
+    // the simulated position, only read by the simulation while it holds
+    // the scene's simulation lock
+    QPointF pos() const { return m_pos; }
+
     void updateImage();
+    void requestFrame();
 
 private:
+    // simulation state, advanced by move() on the simulation thread
     QPointF m_pos;
     qreal m_angle;
-    bool m_walking;
     bool m_walked;
+    int m_animationIndex;
+    EntityPose m_previousPose;
 
+    // commands from the slots, guarded by m_commandLock
+    QMutex m_commandLock;
+    bool m_walking;
     qreal m_turnVelocity;
     QPointF m_turnTarget;
-
     bool m_useTurnTarget;
 
-    int m_animationIndex;
+    EntityPose m_pose;
     int m_angleIndex;
 };
 
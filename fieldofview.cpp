@@ -0,0 +1,189 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include "fieldofview.h"
+
+// Follows the precise permissive field of view algorithm by Jonathon
+// Duerig. Each quadrant is scanned in diagonals moving away from the
+// origin, with the cell coordinates mirrored so x and y grow outwards and
+// the origin cell covers (0, 0) to (1, 1).
+
+FieldOfView::FieldOfView(const QBitArray &blocked, int width, int height)
+    : m_blocked(blocked)
+    , m_width(width)
+    , m_height(height)
+    , m_originX(0)
+    , m_originY(0)
+{
+}
+
+QBitArray FieldOfView::visibleFrom(int x, int y)
+{
+    m_originX = x;
+    m_originY = y;
+    m_visible = QBitArray(m_width * m_height);
+    m_visible.setBit(y * m_width + x);
+
+    const int left = x;
+    const int right = m_width - x - 1;
+    const int top = y;
+    const int bottom = m_height - y - 1;
+
+    scanQuadrant(1, 1, right, bottom);
+    scanQuadrant(1, -1, right, top);
+    scanQuadrant(-1, -1, left, top);
+    scanQuadrant(-1, 1, left, bottom);
+
+    return m_visible;
+}
+
+void FieldOfView::scanQuadrant(int dx, int dy, int extentX, int extentY)
+{
+    m_views.resize(0);
+    m_bumps.resize(0);
+
+    View view;
+    view.shallow = Line(0, 1, extentX, 0);
+    view.steep = Line(1, 0, 0, extentY);
+    view.shallowBump = -1;
+    view.steepBump = -1;
+    m_views << view;
+
+    const int maxI = extentX + extentY;
+    for (int i = 1; i <= maxI && !m_views.isEmpty(); ++i) {
+        const int startJ = qMax(0, i - extentX);
+        const int maxJ = qMin(i, extentY);
+
+        // the cells of a diagonal go from shallow to steep, as do the views
+        int viewIndex = 0;
+        for (int j = startJ; j <= maxJ && viewIndex < m_views.size(); ++j)
+            visit(i - j, j, dx, dy, viewIndex);
+    }
+}
+
+void FieldOfView::visit(int x, int y, int dx, int dy, int &viewIndex)
+{
+    // the cell spans from its top left corner (x, y + 1) to its bottom
+    // right corner (x + 1, y), skip the views that lie below it
+    while (viewIndex < m_views.size() && m_views.at(viewIndex).steep.isBelowOrCollinear(x + 1, y))
+        ++viewIndex;
+
+    if (viewIndex == m_views.size() || m_views.at(viewIndex).shallow.isAboveOrCollinear(x, y + 1))
+        return;
+
+    const int cell = (m_originY + y * dy) * m_width + m_originX + x * dx;
+    m_visible.setBit(cell);
+    if (!m_blocked.testBit(cell))
+        return;
+
+    const View &view = m_views.at(viewIndex);
+    const bool aboveShallow = view.shallow.isAbove(x + 1, y);
+    const bool belowSteep = view.steep.isBelow(x, y + 1);
+
+    if (aboveShallow && belowSteep) {
+        // the cell fills the whole view
+        m_views.remove(viewIndex);
+    } else if (aboveShallow) {
+        addShallowBump(x, y + 1, viewIndex);
+        checkView(viewIndex);
+    } else if (belowSteep) {
+        addSteepBump(x + 1, y, viewIndex);
+        checkView(viewIndex);
+    } else {
+        // the cell splits the view in two
+        const int shallowIndex = viewIndex;
+        int steepIndex = ++viewIndex;
+        m_views.insert(shallowIndex, m_views.at(shallowIndex));
+
+        addSteepBump(x + 1, y, shallowIndex);
+        if (!checkView(shallowIndex)) {
+            --viewIndex;
+            --steepIndex;
+        }
+
+        addShallowBump(x, y + 1, steepIndex);
+        checkView(steepIndex);
+    }
+}
+
+void FieldOfView::addShallowBump(int x, int y, int viewIndex)
+{
+    View &view = m_views[viewIndex];
+    view.shallow.xf = x;
+    view.shallow.yf = y;
+
+    const Bump bump = { x, y, view.shallowBump };
+    m_bumps << bump;
+    view.shallowBump = m_bumps.size() - 1;
+
+    for (int i = view.steepBump; i >= 0; i = m_bumps.at(i).parent) {
+        const Bump &steep = m_bumps.at(i);
+        if (view.shallow.isAbove(steep.x, steep.y)) {
+            view.shallow.xi = steep.x;
+            view.shallow.yi = steep.y;
+        }
+    }
+}
+
+void FieldOfView::addSteepBump(int x, int y, int viewIndex)
+{
+    View &view = m_views[viewIndex];
+    view.steep.xf = x;
+    view.steep.yf = y;
+
+    const Bump bump = { x, y, view.steepBump };
+    m_bumps << bump;
+    view.steepBump = m_bumps.size() - 1;
+
+    for (int i = view.shallowBump; i >= 0; i = m_bumps.at(i).parent) {
+        const Bump &shallow = m_bumps.at(i);
+        if (view.steep.isBelow(shallow.x, shallow.y)) {
+            view.steep.xi = shallow.x;
+            view.steep.yi = shallow.y;
+        }
+    }
+}
+
+// removes a view that narrowed down to a line through a corner of the
+// origin cell, returns false if it was removed
+bool FieldOfView::checkView(int viewIndex)
+{
+    const View &view = m_views.at(viewIndex);
+    if (view.shallow.isCollinear(view.steep)
+        && (view.shallow.isCollinear(0, 1) || view.shallow.isCollinear(1, 0))) {
+        m_views.remove(viewIndex);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,118 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#ifndef FIELDOFVIEW_H
+#define FIELDOFVIEW_H
+
+#include <QBitArray>
+#include <QVector>
+
+// Precise permissive field of view on a grid: a cell is visible from the
+// origin cell if some unobstructed line joins any point of the origin cell
+// to any point of it. Blocked cells can be seen but stop the lines. As it
+// covers every point of the origin cell, the result is a conservative
+// superset of what a camera anywhere in that cell can see.
+class FieldOfView
+{
+public:
+    // blocked has one bit per cell, row by row
+    FieldOfView(const QBitArray &blocked, int width, int height);
+
+    // the cells visible from (x, y), one bit per cell
+    QBitArray visibleFrom(int x, int y);
+
+private:
+    struct Line
+    {
+        Line() : xi(0), yi(0), xf(0), yf(0) {}
+        Line(int xi, int yi, int xf, int yf) : xi(xi), yi(yi), xf(xf), yf(yf) {}
+
+        // positive when the point is below the line
+        int relativeSlope(int x, int y) const
+        {
+            return (yf - yi) * (xf - x) - (xf - xi) * (yf - y);
+        }
+
+        bool isBelow(int x, int y) const { return relativeSlope(x, y) > 0; }
+        bool isBelowOrCollinear(int x, int y) const { return relativeSlope(x, y) >= 0; }
+        bool isAbove(int x, int y) const { return relativeSlope(x, y) < 0; }
+        bool isAboveOrCollinear(int x, int y) const { return relativeSlope(x, y) <= 0; }
+        bool isCollinear(int x, int y) const { return relativeSlope(x, y) == 0; }
+        bool isCollinear(const Line &line) const
+        {
+            return isCollinear(line.xi, line.yi) && isCollinear(line.xf, line.yf);
+        }
+
+        int xi;
+        int yi;
+        int xf;
+        int yf;
+    };
+
+    // corners of blocked cells that narrowed a view, kept as linked lists
+    // through their parent index
+    struct Bump
+    {
+        int x;
+        int y;
+        int parent;
+    };
+
+    // a wedge of lines from the origin cell that is still open
+    struct View
+    {
+        Line shallow;
+        Line steep;
+        int shallowBump;
+        int steepBump;
+    };
+
+    void scanQuadrant(int dx, int dy, int extentX, int extentY);
+    void visit(int x, int y, int dx, int dy, int &viewIndex);
+    void addShallowBump(int x, int y, int viewIndex);
+    void addSteepBump(int x, int y, int viewIndex);
+    bool checkView(int viewIndex);
+
+    QBitArray m_blocked;
+    int m_width;
+    int m_height;
+
+    int m_originX;
+    int m_originY;
+    QBitArray m_visible;
+    QVector<View> m_views;
+    QVector<Bump> m_bumps;
+};
+
+#endif
@@ -0,0 +1,275 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include "floorrenderer.h"
+
+#include <QPainter>
+#include <qmath.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "mazescene.h"
+#include "tracerecorder.h"
+
+QMatrix4x4 fromRotation(float angle, Qt::Axis axis);
+QMatrix4x4 fromProjection(float fovAngle);
+
+static inline uint darken(uint pixel, int alpha)
+{
+    const uint s = 255 - alpha;
+    const uint rb = (((pixel & 0xff00ff) * s) >> 8) & 0xff00ff;
+    const uint g = (((pixel & 0x00ff00) * s) >> 8) & 0x00ff00;
+    return 0xff000000 | rb | g;
+}
+
+// texture coordinates wrap by masking, so the sizes need to be powers of two
+static QImage loadTexture(const QString &fileName)
+{
+    QImage image = QImage(fileName).convertToFormat(QImage::Format_RGB32);
+    if (image.isNull())
+        return QImage(1, 1, QImage::Format_RGB32);
+
+    int width = 1;
+    while (width < image.width())
+        width *= 2;
+    int height = 1;
+    while (height < image.height())
+        height *= 2;
+
+    if (image.size() != QSize(width, height))
+        image = image.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    return image;
+}
+
+static inline int powerOfTwoShift(int value)
+{
+    int shift = 0;
+    while ((1 << shift) < value)
+        ++shift;
+    return shift;
+}
+
+FloorRenderer::FloorRenderer(const TileMap &map)
+    : m_map(map)
+    , m_lightingEnabled(false)
+    , m_floor(loadTexture("floor.png"))
+    , m_ceiling(loadTexture("ceiling.png"))
+    , m_rowFocalLength(0)
+    , m_rowPitch(0)
+    , m_rowScale(0)
+    , m_rowOffset(0)
+    , m_maxDistance(0)
+{
+}
+
+void FloorRenderer::updateRows(const QSize &size, qreal focalLength, qreal pitch,
+                               qreal rowScale, qreal rowOffset)
+{
+    if (size == m_rowSize && focalLength == m_rowFocalLength && pitch == m_rowPitch
+        && rowScale == m_rowScale && rowOffset == m_rowOffset)
+        return;
+
+    m_rowSize = size;
+    m_rowFocalLength = focalLength;
+    m_rowPitch = pitch;
+    m_rowScale = rowScale;
+    m_rowOffset = rowOffset;
+
+    const qreal c = qCos(pitch * M_PI / 180);
+    const qreal s = qSin(pitch * M_PI / 180);
+
+    // the ray through the row in camera space is (x / f, y / f, -1),
+    // undo the pitch to get its height and forward component
+    m_rows.resize(size.height());
+    for (int i = 0; i < size.height(); ++i) {
+        const qreal y = (rowScale * (i + 0.5) + rowOffset) / focalLength;
+        const qreal up = y * c - s;
+        const qreal forward = y * s + c;
+
+        Row &row = m_rows[i];
+        row.valid = !qFuzzyIsNull(up);
+        row.floor = up > 0;
+        row.depth = row.valid ? forward / up : 0;
+        row.spread = row.valid ? 1 / (focalLength * up) : 0;
+    }
+}
+
+void FloorRenderer::renderRow(uint *dst, const Row &row, qreal height, qreal columnScale, qreal columnOffset)
+{
+    const int width = m_image.width();
+    const qreal distance = height * row.depth;
+    if (!row.valid || distance <= 0 || distance > m_maxDistance) {
+        for (int x = 0; x < width; ++x)
+            dst[x] = 0xff000000;
+        return;
+    }
+
+    const QImage &texture = row.floor ? m_floor : m_ceiling;
+    const uint *texels = reinterpret_cast<const uint *>(texture.constBits());
+    const int textureWidth = texture.width();
+    const int textureHeight = texture.height();
+
+    // the texture repeats twice per cell, see MazeScene::drawBackground()
+    const QPointF start = m_origin + (m_forward * row.depth
+                                      + m_right * (row.spread * (0.5 * columnScale + columnOffset))) * height;
+    const QPointF step = m_right * (row.spread * columnScale * height);
+
+    // 16.16 fixed point, wrapping around in the unsigned range keeps the
+    // texel index right as the sizes are powers of two
+    const qreal u = 2 * start.x() * textureWidth;
+    const qreal v = 2 * start.y() * textureHeight;
+    uint fu = uint((u - qFloor(u / textureWidth) * textureWidth) * 65536);
+    uint fv = uint((v - qFloor(v / textureHeight) * textureHeight) * 65536);
+    const int du = int(2 * step.x() * textureWidth * 65536);
+    const int dv = int(2 * step.y() * textureHeight * 65536);
+
+    const uint maskU = textureWidth - 1;
+    const uint maskV = textureHeight - 1;
+    const int shift = powerOfTwoShift(textureWidth);
+
+    int x = 0;
+#ifdef __SSE2__
+    // texel offsets for four pixels at a time, the loads stay scalar
+    __m128i vu = _mm_setr_epi32(fu, fu + du, fu + 2 * du, fu + 3 * du);
+    __m128i vv = _mm_setr_epi32(fv, fv + dv, fv + 2 * dv, fv + 3 * dv);
+    const __m128i stepU = _mm_set1_epi32(4 * du);
+    const __m128i stepV = _mm_set1_epi32(4 * dv);
+    const __m128i vmaskU = _mm_set1_epi32(maskU);
+    const __m128i vmaskV = _mm_set1_epi32(maskV);
+    const __m128i vshift = _mm_cvtsi32_si128(shift);
+
+    union {
+        __m128i vector;
+        int values[4];
+    } offsets;
+
+    for (; x + 4 <= width; x += 4) {
+        const __m128i tu = _mm_and_si128(_mm_srli_epi32(vu, 16), vmaskU);
+        const __m128i tv = _mm_and_si128(_mm_srli_epi32(vv, 16), vmaskV);
+        offsets.vector = _mm_or_si128(tu, _mm_sll_epi32(tv, vshift));
+
+        dst[x] = texels[offsets.values[0]];
+        dst[x + 1] = texels[offsets.values[1]];
+        dst[x + 2] = texels[offsets.values[2]];
+        dst[x + 3] = texels[offsets.values[3]];
+
+        vu = _mm_add_epi32(vu, stepU);
+        vv = _mm_add_epi32(vv, stepV);
+    }
+
+    fu += x * du;
+    fv += x * dv;
+#endif
+
+    for (; x < width; ++x) {
+        dst[x] = texels[(((fv >> 16) & maskV) << shift) | ((fu >> 16) & maskU)];
+        fu += du;
+        fv += dv;
+    }
+}
+
+void FloorRenderer::lightRow(uint *dst, const Row &row, qreal height, qreal columnScale, qreal columnOffset)
+{
+    const qreal distance = height * row.depth;
+    if (!row.valid || distance <= 0 || distance > m_maxDistance || m_cellShadows.isEmpty())
+        return;
+
+    const QPointF start = m_origin + (m_forward * row.depth
+                                      + m_right * (row.spread * (0.5 * columnScale + columnOffset))) * height;
+    const QPointF step = m_right * (row.spread * columnScale * height);
+
+    const int mapWidth = m_map.width();
+    const int mapHeight = m_map.height();
+    const uchar *shadows = reinterpret_cast<const uchar *>(m_cellShadows.constData());
+
+    int fx = int(start.x() * 65536);
+    int fy = int(start.y() * 65536);
+    const int dx = int(step.x() * 65536);
+    const int dy = int(step.y() * 65536);
+
+    const int width = m_image.width();
+    for (int x = 0; x < width; ++x, fx += dx, fy += dy) {
+        const int cx = qBound(0, fx >> 16, mapWidth - 1);
+        const int cy = qBound(0, fy >> 16, mapHeight - 1);
+        dst[x] = darken(dst[x], shadows[cy * mapWidth + cx]);
+    }
+}
+
+void FloorRenderer::render(QPainter *painter, const Camera &camera)
+{
+    TraceScope trace("floorRender", "render");
+
+    const QSize size(painter->device()->width(), painter->device()->height());
+    if (size.isEmpty())
+        return;
+
+    if (m_image.size() != size)
+        m_image = QImage(size, QImage::Format_RGB32);
+
+    // the view only scales and translates the scene
+    const QTransform inverse = painter->combinedTransform().inverted();
+    const qreal focalLength = fromProjection(camera.fov())(0, 0);
+    updateRows(size, focalLength, camera.pitch(), inverse.m22(), inverse.dy());
+
+    const QMatrix4x4 view = fromRotation(-camera.pitch(), Qt::XAxis) * camera.viewMatrix();
+    const QMatrix4x4 inverseView = view.inverted();
+    const QVector3D forward = inverseView.mapVector(QVector3D(0, 0, -1));
+    const QVector3D right = inverseView.mapVector(QVector3D(1, 0, 0));
+
+    m_origin = camera.pos();
+    m_forward = QPointF(forward.x(), forward.z());
+    m_right = QPointF(right.x(), right.z());
+    m_maxDistance = 2 * qMax(m_map.width(), m_map.height());
+
+    const qreal eyeHeight = view(1, 3);
+    const qreal floorHeight = eyeHeight + 0.5;
+    const qreal ceilingHeight = eyeHeight - 0.5;
+
+    for (int y = 0; y < size.height(); ++y) {
+        const Row &row = m_rows.at(y);
+        const qreal height = row.floor ? floorHeight : ceilingHeight;
+        uint *dst = reinterpret_cast<uint *>(m_image.scanLine(y));
+
+        renderRow(dst, row, height, inverse.m11(), inverse.dx());
+        if (m_lightingEnabled)
+            lightRow(dst, row, height, inverse.m11(), inverse.dx());
+    }
+
+    painter->save();
+    painter->resetTransform();
+    painter->drawImage(0, 0, m_image);
+    painter->restore();
+}
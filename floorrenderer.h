@@ -0,0 +1,108 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#ifndef FLOORRENDERER_H
+#define FLOORRENDERER_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QVector>
+
+#include "tilemap.h"
+
+QT_BEGIN_NAMESPACE
+class QPainter;
+QT_END_NAMESPACE
+
+class Camera;
+
+// Renders the floor and ceiling into an image one scanline at a time.
+// Every screen row crosses the floor or ceiling along a line parallel to
+// the camera's right vector, so the texture coordinates step linearly
+// along the row. The per-row distances only depend on the field of view,
+// pitch and viewport and are kept in a table until one of them changes.
+class FloorRenderer
+{
+public:
+    FloorRenderer(const TileMap &map);
+
+    // shadow alpha per cell of the map, row by row
+    void setCellShadows(const QByteArray &shadows) { m_cellShadows = shadows; }
+
+    // darkens each cell with its shadow
+    void setLightingEnabled(bool enabled) { m_lightingEnabled = enabled; }
+    bool isLightingEnabled() const { return m_lightingEnabled; }
+
+    // renders at the size of the painter's device and draws the result,
+    // the painter transform maps the scene to the device
+    void render(QPainter *painter, const Camera &camera);
+
+private:
+    struct Row
+    {
+        // distance along the view direction and sideways spread per unit
+        // of scene x, both per unit of height above or below the eye
+        qreal depth;
+        qreal spread;
+        bool floor;
+        bool valid;
+    };
+
+    void updateRows(const QSize &size, qreal focalLength, qreal pitch, qreal rowScale, qreal rowOffset);
+    void renderRow(uint *dst, const Row &row, qreal height, qreal columnScale, qreal columnOffset);
+    void lightRow(uint *dst, const Row &row, qreal height, qreal columnScale, qreal columnOffset);
+
+    TileMap m_map;
+    QByteArray m_cellShadows;
+    bool m_lightingEnabled;
+
+    QImage m_floor;
+    QImage m_ceiling;
+    QImage m_image;
+
+    QVector<Row> m_rows;
+    QSize m_rowSize;
+    qreal m_rowFocalLength;
+    qreal m_rowPitch;
+    qreal m_rowScale;
+    qreal m_rowOffset;
+
+    // set up in render() for the current frame
+    QPointF m_origin;
+    QPointF m_forward;
+    QPointF m_right;
+    qreal m_maxDistance;
+};
+
+#endif
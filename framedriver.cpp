@@ -0,0 +1,107 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include "framedriver.h"
+#include "mazescene.h"
+
+// refresh interval used when the viewport doesn't sync to the display
+static const qint64 frameInterval = 1000000000 / 60;
+
+// ticks anyway if a frame was never presented, e.g. for a hidden view
+static const int presentTimeout = 100;
+
+FrameDriver::FrameDriver(MazeScene *scene)
+    : QObject(scene)
+    , m_scene(scene)
+    , m_nextFrame(0)
+    , m_synced(false)
+    , m_active(false)
+    , m_waitingForPresent(false)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(tick()));
+    m_clock.start();
+}
+
+void FrameDriver::setSyncedToDisplay(bool synced)
+{
+    m_synced = synced;
+}
+
+void FrameDriver::requestFrame()
+{
+    if (m_active)
+        return;
+
+    m_active = true;
+    m_waitingForPresent = false;
+    m_nextFrame = m_clock.nsecsElapsed();
+    m_timer.start(0);
+}
+
+void FrameDriver::framePresented()
+{
+    if (!m_waitingForPresent)
+        return;
+
+    m_waitingForPresent = false;
+    scheduleTick();
+}
+
+void FrameDriver::scheduleTick()
+{
+    if (m_synced) {
+        // the swap already waited for the display
+        m_timer.start(0);
+        return;
+    }
+
+    // keep to the refresh interval without drifting, but don't try to
+    // make up for frames that were missed
+    const qint64 now = m_clock.nsecsElapsed();
+    m_nextFrame = qMax(m_nextFrame + frameInterval, now);
+    m_timer.start((m_nextFrame - now) / 1000000);
+}
+
+void FrameDriver::tick()
+{
+    if (!m_scene->advanceFrame()) {
+        m_active = false;
+        m_waitingForPresent = false;
+        return;
+    }
+
+    m_waitingForPresent = true;
+    m_timer.start(presentTimeout);
+}
@@ -0,0 +1,83 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#ifndef FRAMEDRIVER_H
+#define FRAMEDRIVER_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+class MazeScene;
+
+// Produces the frames of a scene. Each tick advances the scene, which
+// takes the simulation's state, updates visibility and schedules the
+// paint, in that order. The next tick follows once the view presented
+// the frame: right away when the viewport swaps in sync with the display,
+// otherwise at the next refresh interval. Ticking stops when a frame
+// changed nothing, until requestFrame() is called again.
+class FrameDriver : public QObject
+{
+    Q_OBJECT
+public:
+    FrameDriver(MazeScene *scene);
+
+    void setSyncedToDisplay(bool synced);
+    bool isSyncedToDisplay() const { return m_synced; }
+
+    bool isActive() const { return m_active; }
+
+public slots:
+    void requestFrame();
+
+    // called by the view after it painted a frame
+    void framePresented();
+
+private slots:
+    void tick();
+
+private:
+    void scheduleTick();
+
+    MazeScene *m_scene;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    // when the next timer paced frame is due, in nanoseconds
+    qint64 m_nextFrame;
+    bool m_synced;
+    bool m_active;
+    bool m_waitingForPresent;
+};
+
+#endif
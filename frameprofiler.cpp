@@ -0,0 +1,252 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include "frameprofiler.h"
+
+#include <QPainter>
+
+#include <string.h>
+
+bool FrameProfiler::s_enabled = false;
+
+FrameProfiler::FrameProfiler()
+    : m_head(0)
+    , m_frames(0)
+{
+    memset(m_current, 0, sizeof(m_current));
+    memset(m_history, 0, sizeof(m_history));
+    memset(m_intervals, 0, sizeof(m_intervals));
+    memset(m_counters, 0, sizeof(m_counters));
+}
+
+FrameProfiler *FrameProfiler::instance()
+{
+    static FrameProfiler profiler;
+    return &profiler;
+}
+
+void FrameProfiler::setEnabled(bool enabled)
+{
+    if (s_enabled == enabled)
+        return;
+
+    s_enabled = enabled;
+
+    // start from scratch, old samples would mix with the gap in between
+    m_head = 0;
+    m_frames = 0;
+    memset(m_current, 0, sizeof(m_current));
+    if (enabled)
+        m_frameTimer.start();
+}
+
+void FrameProfiler::endFrame()
+{
+    if (!s_enabled)
+        return;
+
+    m_head = (m_head + 1) % HistoryLength;
+    memcpy(m_history[m_head], m_current, sizeof(m_current));
+    memset(m_current, 0, sizeof(m_current));
+
+    m_intervals[m_head] = m_frameTimer.nsecsElapsed();
+    m_frameTimer.start();
+
+    m_frames = qMin(m_frames + 1, int(HistoryLength));
+}
+
+int FrameProfiler::index(int frame) const
+{
+    return (m_head - frame + HistoryLength) % HistoryLength;
+}
+
+qint64 FrameProfiler::time(Phase phase, int frame) const
+{
+    return frame < m_frames ? m_history[index(frame)][phase] : 0;
+}
+
+qint64 FrameProfiler::frameInterval(int frame) const
+{
+    return frame < m_frames ? m_intervals[index(frame)] : 0;
+}
+
+qint64 FrameProfiler::average(Phase phase) const
+{
+    if (!m_frames)
+        return 0;
+
+    qint64 total = 0;
+    for (int i = 0; i < m_frames; ++i)
+        total += time(phase, i);
+    return total / m_frames;
+}
+
+qint64 FrameProfiler::maximum(Phase phase) const
+{
+    qint64 result = 0;
+    for (int i = 0; i < m_frames; ++i)
+        result = qMax(result, time(phase, i));
+    return result;
+}
+
+// upper limit of each bucket in milliseconds, the last one is open
+int FrameProfiler::bucketLimit(int bucket)
+{
+    static const int limits[HistogramBuckets] = { 8, 17, 25, 34, 50, 0 };
+    return limits[bucket];
+}
+
+void FrameProfiler::histogram(int *buckets) const
+{
+    memset(buckets, 0, HistogramBuckets * sizeof(int));
+    for (int i = 0; i < m_frames; ++i) {
+        const qint64 ms = frameInterval(i) / 1000000;
+
+        int bucket = 0;
+        while (bucket < HistogramBuckets - 1 && ms >= bucketLimit(bucket))
+            ++bucket;
+        ++buckets[bucket];
+    }
+}
+
+const char *FrameProfiler::phaseName(Phase phase)
+{
+    static const char *names[PhaseCount] = {
+        "move",
+        "transforms",
+        "paint",
+        "  background",
+        "  widgets",
+        "  model"
+    };
+    return names[phase];
+}
+
+const char *FrameProfiler::counterName(Counter counter)
+{
+    static const char *names[CounterCount] = {
+        "visible items",
+        "obscured items",
+        "spans",
+        "moved entities"
+    };
+    return names[counter];
+}
+
+static const int hudWidth = 320;
+static const int hudRowHeight = 14;
+static const int hudGraphWidth = FrameProfiler::HistoryLength;
+
+ProfilerItem::ProfilerItem()
+{
+    setFlag(ItemIgnoresTransformations);
+    setVisible(false);
+}
+
+QRectF ProfilerItem::boundingRect() const
+{
+    const int rows = FrameProfiler::PhaseCount + FrameProfiler::CounterCount + 4;
+    return QRectF(0, 0, hudWidth, rows * hudRowHeight + 8);
+}
+
+void ProfilerItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
+{
+    const FrameProfiler *profiler = FrameProfiler::instance();
+
+    painter->fillRect(boundingRect(), QColor(0, 0, 0, 160));
+
+    QFont font = painter->font();
+    font.setPixelSize(hudRowHeight - 3);
+    painter->setFont(font);
+
+    const int graphLeft = hudWidth - hudGraphWidth - 4;
+    const qreal graphScale = (hudRowHeight - 2) / 16.0e6; // 16 ms fills a row
+
+    int y = 4;
+    painter->setPen(Qt::white);
+    painter->drawText(QRect(4, y, graphLeft, hudRowHeight), Qt::AlignVCenter, "ms  avg / max");
+    y += hudRowHeight;
+
+    // one row per phase, with a bar graph of the recent frames
+    for (int i = 0; i < FrameProfiler::PhaseCount; ++i) {
+        const FrameProfiler::Phase phase = FrameProfiler::Phase(i);
+
+        painter->setPen(Qt::white);
+        painter->drawText(QRect(4, y, graphLeft, hudRowHeight), Qt::AlignVCenter,
+                          QString("%0 %1 / %2").arg(FrameProfiler::phaseName(phase))
+                          .arg(profiler->average(phase) / 1e6, 0, 'f', 2)
+                          .arg(profiler->maximum(phase) / 1e6, 0, 'f', 2));
+
+        painter->setPen(QColor(0, 255, 0, 200));
+        const int baseline = y + hudRowHeight - 1;
+        for (int frame = 0; frame < profiler->frames(); ++frame) {
+            const int x = graphLeft + hudGraphWidth - 1 - frame;
+            const int height = qMin(hudRowHeight - 2, int(profiler->time(phase, frame) * graphScale + 0.5));
+            if (height > 0)
+                painter->drawLine(x, baseline, x, baseline - height + 1);
+        }
+
+        y += hudRowHeight;
+    }
+
+    painter->setPen(Qt::white);
+    for (int i = 0; i < FrameProfiler::CounterCount; ++i) {
+        const FrameProfiler::Counter counter = FrameProfiler::Counter(i);
+        painter->drawText(QRect(4, y, hudWidth - 8, hudRowHeight), Qt::AlignVCenter,
+                          QString("%0: %1").arg(FrameProfiler::counterName(counter))
+                          .arg(profiler->counter(counter)));
+        y += hudRowHeight;
+    }
+
+    // frame interval histogram
+    y += hudRowHeight / 2;
+    painter->drawText(QRect(4, y, hudWidth - 8, hudRowHeight), Qt::AlignVCenter, "frame interval");
+    y += hudRowHeight;
+
+    int buckets[FrameProfiler::HistogramBuckets];
+    profiler->histogram(buckets);
+
+    const int bucketWidth = (hudWidth - 8) / FrameProfiler::HistogramBuckets;
+    for (int i = 0; i < FrameProfiler::HistogramBuckets; ++i) {
+        const int x = 4 + i * bucketWidth;
+        const QString label = FrameProfiler::bucketLimit(i)
+            ? QString("<%0").arg(FrameProfiler::bucketLimit(i))
+            : QString(">=%0").arg(FrameProfiler::bucketLimit(i - 1));
+
+        const qreal share = profiler->frames() ? buckets[i] / qreal(profiler->frames()) : 0;
+        painter->fillRect(QRectF(x, y, (bucketWidth - 2) * share, hudRowHeight - 2),
+                          i < 2 ? QColor(0, 200, 0) : QColor(220, 60, 0));
+        painter->drawText(QRect(x + 2, y, bucketWidth - 4, hudRowHeight), Qt::AlignVCenter, label);
+    }
+}
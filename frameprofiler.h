@@ -0,0 +1,150 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include <QElapsedTimer>
+#include <QGraphicsItem>
+
+// Collects the time spent in each phase of a frame and a few counters,
+// keeping the last HistoryLength frames. Timing is only done while the
+// profiler is enabled, otherwise a ProfileScope costs a flag test.
+class FrameProfiler
+{
+public:
+    enum Phase
+    {
+        Move,
+        UpdateTransforms,
+        Paint,
+        DrawBackground,
+        ProxyWidgets,
+        ModelPaint,
+        PhaseCount
+    };
+
+    enum Counter
+    {
+        VisibleItems,
+        ObscuredItems,
+        Spans,
+        MovedEntities,
+        CounterCount
+    };
+
+    enum { HistoryLength = 120, HistogramBuckets = 6 };
+
+    static FrameProfiler *instance();
+
+    static bool isEnabled() { return s_enabled; }
+    void setEnabled(bool enabled);
+
+    void addTime(Phase phase, qint64 nsecs) { m_current[phase] += nsecs; }
+    void setCounter(Counter counter, int value) { m_counters[counter] = value; }
+    int counter(Counter counter) const { return m_counters[counter]; }
+
+    // stores the times of the current frame and starts a new one
+    void endFrame();
+
+    int frames() const { return m_frames; }
+
+    // frame 0 is the most recent one, times are in nanoseconds
+    qint64 time(Phase phase, int frame) const;
+    qint64 frameInterval(int frame) const;
+    qint64 average(Phase phase) const;
+    qint64 maximum(Phase phase) const;
+
+    // number of recent frame intervals per bucket, see bucketLimit()
+    void histogram(int *buckets) const;
+    static int bucketLimit(int bucket);
+
+    static const char *phaseName(Phase phase);
+    static const char *counterName(Counter counter);
+
+private:
+    FrameProfiler();
+
+    int index(int frame) const;
+
+    static bool s_enabled;
+
+    qint64 m_current[PhaseCount];
+    qint64 m_history[HistoryLength][PhaseCount];
+    qint64 m_intervals[HistoryLength];
+    int m_counters[CounterCount];
+
+    int m_head;
+    int m_frames;
+    QElapsedTimer m_frameTimer;
+};
+
+// Adds the time until the end of the enclosing scope to a phase.
+class ProfileScope
+{
+public:
+    // scopes that are not counted pass false, e.g. for embedded scenes
+    // whose work is already inside the outer scene's scopes
+    ProfileScope(FrameProfiler::Phase phase, bool counted = true)
+        : m_phase(phase)
+        , m_active(counted && FrameProfiler::isEnabled())
+    {
+        if (m_active)
+            m_timer.start();
+    }
+
+    ~ProfileScope()
+    {
+        if (m_active)
+            FrameProfiler::instance()->addTime(m_phase, m_timer.nsecsElapsed());
+    }
+
+private:
+    FrameProfiler::Phase m_phase;
+    bool m_active;
+    QElapsedTimer m_timer;
+};
+
+// Overlay showing the recent phase times, counters and a histogram of the
+// frame intervals. Ignores the view transform so it's drawn in pixels.
+class ProfilerItem : public QGraphicsItem
+{
+public:
+    ProfilerItem();
+
+    QRectF boundingRect() const;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
+};
+
+#endif
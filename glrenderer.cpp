@@ -0,0 +1,537 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include "glrenderer.h"
+
+#ifdef USE_GL_RENDERER
+
+#include <GL/glew.h>
+#include <QtOpenGL>
+
+#include "mazescene.h"
+
+QMatrix4x4 fromRotation(float angle, Qt::Axis axis);
+
+static const char *vertexProgram =
+    "#version 120\n"
+    "attribute vec3 position;"
+    "attribute vec3 texCoord;"
+    "attribute float shade;"
+    "uniform mat4 viewProjection;"
+    "uniform mat3 screen;"
+    "uniform vec2 shadowScale;"
+    "varying vec3 textureCoord;"
+    "varying vec2 shadowCoord;"
+    "varying float constantShade;"
+    "void main() {"
+    // project like the items do, then map to the view with the painter's
+    // transform, which is affine so w stays the camera space w
+    "   vec4 p = viewProjection * vec4(position, 1.0);"
+    "   vec3 s = screen * vec3(p.x, p.y, p.w);"
+    "   gl_Position = vec4(s.x, s.y, p.z, s.z);"
+    "   textureCoord = texCoord;"
+    "   shadowCoord = (position.xz + 0.5) * shadowScale;"
+    "   constantShade = shade;"
+    "}";
+
+static const char *fragmentProgram =
+    "#version 120\n"
+    "#extension GL_EXT_texture_array : require\n"
+    "uniform sampler2DArray textures;"
+    "uniform sampler2D shadows;"
+    "varying vec3 textureCoord;"
+    "varying vec2 shadowCoord;"
+    "varying float constantShade;"
+    "void main() {"
+    "   float alpha = constantShade < 0.0 ? texture2D(shadows, shadowCoord).a : constantShade;"
+    "   vec4 color = textureCoord.z < 0.0 ? vec4(0.0) : texture2DArray(textures, textureCoord);"
+    // premultiplied, the shadow is blended over the texture
+    "   gl_FragColor = vec4(color.rgb * (1.0 - alpha), color.a + alpha * (1.0 - color.a));"
+    "}";
+
+enum Layer
+{
+    NoTexture = -1,
+    BrownLayer,
+    BookLayer,
+    DoorLayer,
+    FloorLayer,
+    CeilingLayer,
+    LayerCount
+};
+
+static const int textureSize = 64;
+
+GLRenderer::GLRenderer(const TileMap &map, const QVector<WallItem *> &walls)
+    : m_map(map)
+    , m_walls(walls)
+    , m_cornerShadows((map.width() + 1) * (map.height() + 1), 0)
+    , m_context(0)
+    , m_program(0)
+    , m_vertexBuffer(0)
+    , m_textureArray(0)
+    , m_shadowTexture(0)
+    , m_failed(false)
+    , m_dirtyCorners(0, 0, map.width() + 1, map.height() + 1)
+{
+    buildVertices();
+}
+
+GLRenderer::~GLRenderer()
+{
+    release();
+}
+
+void GLRenderer::setCornerShadows(const QByteArray &shadows, const QRect &changed)
+{
+    m_cornerShadows = shadows;
+    m_dirtyCorners |= changed;
+}
+
+// the quad of a wall, as WallItem would draw it from its image and shadow,
+// or of count of its cells from first on if count is given
+void GLRenderer::wallVertices(const WallItem *wall, Vertex *vertices, int first, int count) const
+{
+    const QPointF a = wall->a();
+    const QPointF b = wall->b();
+    const QPointF center = (a + b) / 2;
+
+    QMatrix4x4 m;
+    m.translate(center.x(), 0, center.y());
+    m *= fromRotation(-QLineF(b, a).angle(), Qt::YAxis);
+
+    const QRectF bounds = wall->boundingRect();
+    QRectF target = wall->targetRect();
+    const qreal visible = target.width() / bounds.width();
+
+    int layer;
+    qreal repeat = qMax(1, qRound(QLineF(a, b).length()));
+    switch (wall->type()) {
+    case TileMap::Door:
+        layer = DoorLayer;
+        repeat = 1;
+        break;
+    case 1:
+        layer = BookLayer;
+        break;
+    case 2:
+        layer = NoTexture;
+        break;
+    default:
+        layer = BrownLayer;
+        break;
+    }
+
+    // the see-through walls get a constant shadow, see the WallItem constructor
+    const float shade = wall->type() == 2 ? 100 / 255.0f : -1;
+
+    const QPointF corners[] = {
+        target.topLeft(), target.topRight(), target.bottomRight(), target.bottomLeft()
+    };
+    const qreal u[] = { left, right, right, left };
+    qreal left = 0;
+    qreal right = repeat * visible;
+    if (count > 0) {
+        // doors are never merged, so parts are always fully visible
+        const int cells = wall->cellCount();
+        const qreal width = bounds.width() / cells;
+        target = QRectF(bounds.left() + first * width, bounds.top(), count * width, bounds.height());
+        left = repeat * first / cells;
+        right = repeat * (first + count) / cells;
+    }
+
+    const qreal v[] = { 0, 0, 1, 1 };
+
+    for (int i = 0; i < 4; ++i) {
+        const QVector3D pos = m.map(QVector3D(corners[i].x(), corners[i].y(), 0));
+        Vertex &vertex = vertices[i];
+        vertex.x = pos.x();
+        vertex.y = pos.y();
+        vertex.z = pos.z();
+        vertex.u = u[i];
+        vertex.v = v[i];
+        vertex.layer = layer;
+        vertex.shade = shade;
+    }
+}
+
+void GLRenderer::buildVertices()
+{
+    int cellQuads = 0;
+    foreach (const WallItem *wall, m_walls) {
+        if (wall->cellCount() > 1)
+            cellQuads += wall->cellCount();
+    }
+
+    m_vertices.resize(m_walls.size() * 4 + 8 + cellQuads * 4);
+    m_doors.clear();
+    m_doorWidths.clear();
+    m_cellVertices.fill(-1, m_walls.size());
+
+    for (int i = 0; i < m_walls.size(); ++i) {
+        const WallItem *wall = m_walls.at(i);
+        wallVertices(wall, m_vertices.data() + i * 4);
+
+        if (wall->type() == TileMap::Door) {
+            m_doors << i;
+            m_doorWidths << wall->targetRect().width();
+        }
+    }
+
+    // floor and ceiling cover the inside of the map, with the texture
+    // repeated twice per cell like the brushes in drawBackground()
+    const float left = 1;
+    const float top = 1;
+    const float right = m_map.width() - 1;
+    const float bottom = m_map.height() - 1;
+
+    Vertex *vertex = m_vertices.data() + m_walls.size() * 4;
+    for (int i = 0; i < 2; ++i) {
+        const float y = i == 0 ? 0.5f : -0.5f;
+        const float layer = i == 0 ? FloorLayer : CeilingLayer;
+
+        Vertex corners[] = {
+            { left, y, top, 2 * left, 2 * top, layer, 0 },
+            { right, y, top, 2 * right, 2 * top, layer, 0 },
+            { right, y, bottom, 2 * right, 2 * bottom, layer, 0 },
+            { left, y, bottom, 2 * left, 2 * bottom, layer, 0 }
+        };
+
+        for (int j = 0; j < 4; ++j)
+            *vertex++ = corners[j];
+    }
+
+    // merged walls again cell by cell, after the floor and ceiling
+    for (int i = 0; i < m_walls.size(); ++i) {
+        const WallItem *wall = m_walls.at(i);
+        if (wall->cellCount() == 1)
+            continue;
+
+        m_cellVertices[i] = vertex - m_vertices.data();
+        for (int j = 0; j < wall->cellCount(); ++j) {
+            wallVertices(wall, vertex, j, 1);
+            vertex += 4;
+        }
+    }
+}
+
+bool GLRenderer::isUsable(QPainter *painter)
+{
+    QPaintEngine *engine = painter->paintEngine();
+    if (!engine || engine->type() != QPaintEngine::OpenGL2)
+        return false;
+
+    const QGLContext *context = QGLContext::currentContext();
+    if (!context)
+        return false;
+
+    if (context != m_context) {
+        release();
+        m_context = context;
+        m_failed = false;
+
+        QPaintDevice *device = painter->device();
+        if (device->devType() == QInternal::Widget)
+            m_widget = qobject_cast<QGLWidget *>(static_cast<QWidget *>(device));
+
+        painter->beginNativePainting();
+        m_failed = !initialize();
+        if (m_failed)
+            deleteObjects();
+        painter->endNativePainting();
+    }
+
+    return !m_failed;
+}
+
+// Frees the objects of the previous context. If that context is still
+// around, e.g. when the renderer goes away before the view, it's made
+// current for that, otherwise the objects went away with it.
+void GLRenderer::release()
+{
+    if (m_widget && m_widget->context() == m_context) {
+        const QGLContext *current = QGLContext::currentContext();
+        if (current != m_context)
+            m_widget->makeCurrent();
+
+        deleteObjects();
+
+        if (!current)
+            m_widget->doneCurrent();
+        else if (current != m_context)
+            const_cast<QGLContext *>(current)->makeCurrent();
+    }
+
+    delete m_program;
+    m_program = 0;
+    m_vertexBuffer = 0;
+    m_textureArray = 0;
+    m_shadowTexture = 0;
+    m_context = 0;
+    m_widget = 0;
+    m_dirtyCorners = QRect(0, 0, m_map.width() + 1, m_map.height() + 1);
+}
+
+// deletes the objects in the current context
+void GLRenderer::deleteObjects()
+{
+    if (m_vertexBuffer)
+        glDeleteBuffers(1, &m_vertexBuffer);
+    if (m_textureArray)
+        glDeleteTextures(1, &m_textureArray);
+    if (m_shadowTexture)
+        glDeleteTextures(1, &m_shadowTexture);
+
+    delete m_program;
+    m_program = 0;
+    m_vertexBuffer = 0;
+    m_textureArray = 0;
+    m_shadowTexture = 0;
+}
+
+bool GLRenderer::initialize()
+{
+    glewInit();
+    if (!GLEW_VERSION_2_0 || !(GLEW_EXT_texture_array || GLEW_VERSION_3_0)) {
+        qWarning() << "GLRenderer: texture arrays not supported, using QPainter";
+        return false;
+    }
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    if (m_map.width() + 1 > maxTextureSize || m_map.height() + 1 > maxTextureSize) {
+        qWarning() << "GLRenderer: the shadow texture for a" << m_map.width() << "x" << m_map.height()
+                   << "map exceeds the maximum texture size of" << maxTextureSize << ", using QPainter";
+        return false;
+    }
+
+    m_program = new QGLShaderProgram;
+    m_program->addShaderFromSourceCode(QGLShader::Vertex, vertexProgram);
+    m_program->addShaderFromSourceCode(QGLShader::Fragment, fragmentProgram);
+    m_program->bindAttributeLocation("position", 0);
+    m_program->bindAttributeLocation("texCoord", 1);
+    m_program->bindAttributeLocation("shade", 2);
+    if (!m_program->link()) {
+        qWarning() << "GLRenderer: failed to link the shaders, using QPainter:" << m_program->log();
+        return false;
+    }
+
+    const char *textures[LayerCount] = {
+        "brown.png", "book.png", "door.png", "floor.png", "ceiling.png"
+    };
+
+    glGenTextures(1, &m_textureArray);
+    glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, m_textureArray);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY_EXT, 0, GL_RGBA8, textureSize, textureSize, LayerCount,
+                 0, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+    for (int i = 0; i < LayerCount; ++i) {
+        QImage image = QImage(textures[i]).convertToFormat(QImage::Format_ARGB32);
+        if (image.isNull())
+            continue;
+        if (image.size() != QSize(textureSize, textureSize))
+            image = image.scaled(textureSize, textureSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY_EXT, 0, 0, 0, i, textureSize, textureSize, 1,
+                        GL_BGRA, GL_UNSIGNED_BYTE, image.constBits());
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, 0);
+
+    glGenTextures(1, &m_shadowTexture);
+    glBindTexture(GL_TEXTURE_2D, m_shadowTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA8, m_map.width() + 1, m_map.height() + 1,
+                 0, GL_ALPHA, GL_UNSIGNED_BYTE, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // the doors may have moved since the vertices were built
+    buildVertices();
+
+    glGenBuffers(1, &m_vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(Vertex), m_vertices.constData(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_dirtyCorners = QRect(0, 0, m_map.width() + 1, m_map.height() + 1);
+
+    const GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        qWarning() << "GLRenderer: OpenGL error" << error << "while setting up, using QPainter";
+        return false;
+    }
+    return true;
+}
+
+// uploads the corners that changed, which is only the reach of the moving
+// lights while the torch is on
+void GLRenderer::updateShadows()
+{
+    const QRect &r = m_dirtyCorners;
+    const int stride = m_map.width() + 1;
+
+    glBindTexture(GL_TEXTURE_2D, m_shadowTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, r.x(), r.y(), r.width(), r.height(),
+                    GL_ALPHA, GL_UNSIGNED_BYTE, m_cornerShadows.constData() + r.y() * stride + r.x());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_dirtyCorners = QRect();
+}
+
+// door quads shrink while the doors slide open
+void GLRenderer::updateDoors()
+{
+    for (int i = 0; i < m_doors.size(); ++i) {
+        const int index = m_doors.at(i);
+        const qreal width = m_walls.at(index)->targetRect().width();
+        if (width == m_doorWidths.at(i))
+            continue;
+
+        m_doorWidths[i] = width;
+        wallVertices(m_walls.at(index), m_vertices.data() + index * 4);
+        glBufferSubData(GL_ARRAY_BUFFER, index * 4 * sizeof(Vertex), 4 * sizeof(Vertex),
+                        m_vertices.constData() + index * 4);
+    }
+}
+
+void GLRenderer::begin(QPainter *painter, const Camera &camera)
+{
+    painter->beginNativePainting();
+
+    if (!m_dirtyCorners.isEmpty())
+        updateShadows();
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    updateDoors();
+
+    // maps the projected scene coordinates to clip space
+    const QTransform t = painter->combinedTransform();
+    const qreal sx = 2.0 / painter->device()->width();
+    const qreal sy = -2.0 / painter->device()->height();
+    const qreal screen[] = {
+        sx * t.m11() - t.m13(), sx * t.m21() - t.m23(), sx * t.dx() - t.m33(),
+        sy * t.m12() + t.m13(), sy * t.m22() + t.m23(), sy * t.dy() + t.m33(),
+        t.m13(), t.m23(), t.m33()
+    };
+
+    m_program->bind();
+    m_program->setUniformValue("viewProjection", camera.viewProjectionMatrix());
+    m_program->setUniformValue("screen", QMatrix3x3(screen));
+    m_program->setUniformValue("shadowScale", QVector2D(1.0 / (m_map.width() + 1), 1.0 / (m_map.height() + 1)));
+    m_program->setUniformValue("textures", 0);
+    m_program->setUniformValue("shadows", 1);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, m_textureArray);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_shadowTexture);
+
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    const char *base = 0;
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), base + offsetof(Vertex, x));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), base + offsetof(Vertex, u));
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), base + offsetof(Vertex, shade));
+}
+
+void GLRenderer::end(QPainter *painter)
+{
+    glDisableVertexAttribArray(2);
+    glDisableVertexAttribArray(1);
+    glDisableVertexAttribArray(0);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_program->release();
+    painter->endNativePainting();
+}
+
+void GLRenderer::drawFloorAndCeiling(QPainter *painter, const Camera &camera)
+{
+    begin(painter, camera);
+
+    const int first = m_walls.size() * 4;
+    glDrawArrays(GL_TRIANGLE_FAN, first, 4);
+    glDrawArrays(GL_TRIANGLE_FAN, first + 4, 4);
+
+    end(painter);
+}
+
+// draws the walls in the given order, which is back to front
+void GLRenderer::drawWalls(QPainter *painter, const Camera &camera, const QVector<WallPiece> &walls)
+{
+    if (walls.isEmpty())
+        return;
+
+    m_indices.resize(0);
+    foreach (const WallPiece &piece, walls) {
+        const int index = piece.wall->batchIndex();
+        if (piece.count == piece.wall->cellCount()) {
+            const uint first = index * 4;
+            m_indices << first << first + 1 << first + 2
+                      << first << first + 2 << first + 3;
+            continue;
+        }
+
+        for (int i = piece.first; i < piece.first + piece.count; ++i) {
+            const uint first = m_cellVertices.at(index) + i * 4;
+            m_indices << first << first + 1 << first + 2
+                      << first << first + 2 << first + 3;
+        }
+    }
+
+    begin(painter, camera);
+    glDrawElements(GL_TRIANGLES, m_indices.size(), GL_UNSIGNED_INT, m_indices.constData());
+    end(painter);
+}
+
+#endif
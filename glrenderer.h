@@ -0,0 +1,134 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#ifndef GLRENDERER_H
+#define GLRENDERER_H
+
+#ifdef USE_GL_RENDERER
+
+#include <QByteArray>
+#include <QPointer>
+#include <QRect>
+#include <QVector>
+
+#include "tilemap.h"
+
+QT_BEGIN_NAMESPACE
+class QGLContext;
+class QGLWidget;
+class QGLShaderProgram;
+class QPainter;
+QT_END_NAMESPACE
+
+class Camera;
+class WallItem;
+struct WallPiece;
+
+// Draws the batched walls, floor and ceiling with native OpenGL when the
+// view paints with the OpenGL 2 engine. All wall quads live in one static
+// vertex buffer and the wall, floor and ceiling textures in one texture
+// array, so each wall batch and the floor and ceiling take a single draw
+// call. Shadows come from a texture holding the shadow value at every
+// cell corner, which the shader samples and blends over the textures.
+class GLRenderer
+{
+public:
+    // walls are the scene's batched walls, in batch index order
+    GLRenderer(const TileMap &map, const QVector<WallItem *> &walls);
+    ~GLRenderer();
+
+    // true if the painter paints with OpenGL and the renderer could
+    // set itself up in its context
+    bool isUsable(QPainter *painter);
+
+    // shadow alpha at every cell corner, row by row, with the corners
+    // that changed since the last call
+    void setCornerShadows(const QByteArray &shadows, const QRect &changed);
+
+    void drawFloorAndCeiling(QPainter *painter, const Camera &camera);
+    void drawWalls(QPainter *painter, const Camera &camera, const QVector<WallPiece> &walls);
+
+private:
+    struct Vertex
+    {
+        float x;
+        float y;
+        float z;
+        float u;
+        float v;
+        float layer;
+        // constant shadow alpha, or -1 to use the shadow texture
+        float shade;
+    };
+
+    bool initialize();
+    void release();
+    void deleteObjects();
+
+    void buildVertices();
+    void wallVertices(const WallItem *wall, Vertex *vertices, int first = 0, int count = 0) const;
+    void updateDoors();
+    void updateShadows();
+
+    void begin(QPainter *painter, const Camera &camera);
+    void end(QPainter *painter);
+
+    TileMap m_map;
+    QVector<WallItem *> m_walls;
+    QByteArray m_cornerShadows;
+
+    QVector<Vertex> m_vertices;
+    QVector<int> m_doors;
+    QVector<qreal> m_doorWidths;
+    // first vertex of the per cell quads of each merged wall, used when
+    // only part of it is drawn, or -1 for single cell walls
+    QVector<int> m_cellVertices;
+    QVector<uint> m_indices;
+
+    const QGLContext *m_context;
+    // the widget owning m_context, null once it and the objects are gone
+    QPointer<QGLWidget> m_widget;
+    QGLShaderProgram *m_program;
+    uint m_vertexBuffer;
+    uint m_textureArray;
+    uint m_shadowTexture;
+
+    bool m_failed;
+    // corners not yet uploaded to the shadow texture
+    QRect m_dirtyCorners;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,80 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include "lightgrid.h"
+
+#include <qmath.h>
+
+LightGrid::LightGrid(int width, int height)
+    : m_width(width)
+    , m_height(height)
+    , m_cells(width * height)
+{
+}
+
+QRect LightGrid::cellsInReach(const QPointF &pos, qreal reach) const
+{
+    const QRect cells(QPoint(qFloor(pos.x() - reach), qFloor(pos.y() - reach)),
+                      QPoint(qFloor(pos.x() + reach), qFloor(pos.y() + reach)));
+    return cells & QRect(0, 0, m_width, m_height);
+}
+
+void LightGrid::insert(int light, const QPointF &pos, qreal reach)
+{
+    const QRect cells = cellsInReach(pos, reach);
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x)
+            m_cells[y * m_width + x].append(light);
+    }
+}
+
+void LightGrid::remove(int light, const QPointF &pos, qreal reach)
+{
+    const QRect cells = cellsInReach(pos, reach);
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            QVector<int> &lights = m_cells[y * m_width + x];
+            const int index = lights.indexOf(light);
+            if (index >= 0)
+                lights.remove(index);
+        }
+    }
+}
+
+const QVector<int> &LightGrid::lightsAt(const QPointF &pos) const
+{
+    const int x = qBound(0, qFloor(pos.x()), m_width - 1);
+    const int y = qBound(0, qFloor(pos.y()), m_height - 1);
+    return m_cells.at(y * m_width + x);
+}
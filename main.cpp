@@ -34,6 +34,9 @@ POSSIBILITY OF SUCH DAMAGE."
 ****************************************************************************/
 #include <QtGui>
 #include "mazescene.h"
+#include "mapfile.h"
+#include "mazegenerator.h"
+#include "tracerecorder.h"
 
 int main(int argc, char **argv)
 {
@@ -60,7 +63,109 @@ int main(int argc, char **argv)
            << Light(QPointF(3.5, 6.5), 1)
            << Light(QPointF(1.5, 10.5), 0.3);
 
-    MazeScene *scene = new MazeScene(lights, map, 8, 12);
+    const TileMap tileMap(map, 8, 12);
+
+    MazeScene *scene = 0;
+
+    // settings for --generate
+    QSize generatedSize(64, 64);
+    uint seed = 1;
+    qreal wallDensity = 0.8;
+    int doorCount = 0;
+    int lightCount = 0;
+    int entityCount = 0;
+    int widgetCount = 0;
+    QVector<int> widgetTypes;
+
+    bool software = false;
+    bool lightOcclusion = true;
+    bool threadedSimulation = true;
+
+    // acted on once all options are parsed, as they depend on the others
+    QString saveMapFile;
+    QString generateFile;
+    QString mapFile;
+
+    const QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); ++i) {
+        const QString arg = args.at(i);
+        const bool hasValue = i + 1 < args.size();
+        if (arg == QLatin1String("--save-map") && hasValue) {
+            saveMapFile = args.at(++i);
+        } else if (arg == QLatin1String("--size") && hasValue) {
+            const QStringList parts = args.at(++i).split('x');
+            if (parts.size() == 2)
+                generatedSize = QSize(parts.at(0).toInt(), parts.at(1).toInt());
+        } else if (arg == QLatin1String("--seed") && hasValue) {
+            seed = args.at(++i).toUInt();
+        } else if (arg == QLatin1String("--wall-density") && hasValue) {
+            wallDensity = args.at(++i).toDouble();
+        } else if (arg == QLatin1String("--doors") && hasValue) {
+            doorCount = args.at(++i).toInt();
+        } else if (arg == QLatin1String("--lights") && hasValue) {
+            lightCount = args.at(++i).toInt();
+        } else if (arg == QLatin1String("--entities") && hasValue) {
+            entityCount = args.at(++i).toInt();
+        } else if (arg == QLatin1String("--widgets") && hasValue) {
+            // comma separated wall types, optionally followed by :count
+            const QStringList parts = args.at(++i).split(':');
+            foreach (const QString &type, parts.at(0).split(',', QString::SkipEmptyParts))
+                widgetTypes << type.toInt();
+            widgetCount = parts.size() > 1 ? parts.at(1).toInt() : widgetTypes.size();
+        } else if (arg == QLatin1String("--software")) {
+            software = true;
+        } else if (arg == QLatin1String("--no-light-occlusion")) {
+            lightOcclusion = false;
+        } else if (arg == QLatin1String("--no-simulation-thread")) {
+            threadedSimulation = false;
+        } else if (arg == QLatin1String("--trace") && hasValue) {
+            TraceRecorder::instance()->start(args.at(++i));
+            QObject::connect(&app, SIGNAL(aboutToQuit()), TraceRecorder::instance(), SLOT(stop()));
+        } else if (arg == QLatin1String("--trace-seconds") && hasValue) {
+            QTimer::singleShot(args.at(++i).toDouble() * 1000, TraceRecorder::instance(), SLOT(stop()));
+        } else if (arg == QLatin1String("--generate") && hasValue) {
+            generateFile = args.at(++i);
+        } else if (mapFile.isEmpty()) {
+            mapFile = arg;
+        }
+    }
+
+    if (!saveMapFile.isEmpty()) {
+        if (!MapFile::save(saveMapFile, tileMap, QPointF(1.5, 1.5), 0.1, lights)) {
+            qWarning() << "Failed to save map" << saveMapFile;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!generateFile.isEmpty()) {
+        MazeGenerator generator(generatedSize.width(), generatedSize.height(), seed);
+        generator.setWallDensity(wallDensity);
+        generator.setDoorCount(doorCount);
+        generator.setLightCount(lightCount);
+        generator.setEntityCount(entityCount);
+        generator.setWidgetTypes(widgetTypes);
+        generator.setWidgetCount(widgetCount);
+        generator.generate();
+
+        if (!generator.save(generateFile)) {
+            qWarning() << "Failed to save map" << generateFile;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!mapFile.isEmpty()) {
+        scene = MazeScene::load(mapFile);
+        if (!scene)
+            return 1;
+    } else {
+        scene = new MazeScene(lights, tileMap);
+    }
+
+    scene->setSoftwareRendering(software);
+    scene->setLightOcclusion(lightOcclusion);
+    scene->setThreadedSimulation(threadedSimulation);
 
     View view;
     view.resize(800, 600);
@@ -0,0 +1,216 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include "mapfile.h"
+#include "mazescene.h"
+
+#include <string.h>
+
+static const char mapMagic[4] = { 'W', 'Q', 'M', 'P' };
+static const quint32 mapVersion = 1;
+static const quint32 mapByteOrder = 0x01020304;
+
+int MapFile::tilesSize(int width, int height)
+{
+    return (width * height + 3) & ~3;
+}
+
+MapFile::MapFile(const QString &fileName)
+    : m_file(fileName)
+    , m_header(0)
+    , m_tiles(0)
+    , m_lights(0)
+    , m_spawns(0)
+    , m_widgets(0)
+{
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_errorString = m_file.errorString();
+        return;
+    }
+
+    const qint64 size = m_file.size();
+    if (size < qint64(sizeof(MapFileHeader))) {
+        m_errorString = QLatin1String("File too small");
+        return;
+    }
+
+    const uchar *data = m_file.map(0, size);
+    if (!data) {
+        m_errorString = m_file.errorString();
+        return;
+    }
+
+    const MapFileHeader *header = reinterpret_cast<const MapFileHeader *>(data);
+    if (memcmp(header->magic, mapMagic, sizeof(mapMagic))
+        || header->version != mapVersion
+        || header->byteOrder != mapByteOrder)
+    {
+        m_errorString = QLatin1String("Not a map file of a supported version");
+        return;
+    }
+
+    if (header->width <= 0 || header->height <= 0
+        || header->width > 0x4000 || header->height > 0x4000)
+    {
+        m_errorString = QLatin1String("Invalid map size");
+        return;
+    }
+
+    const qint64 expected = sizeof(MapFileHeader)
+        + tilesSize(header->width, header->height)
+        + qint64(header->lightCount) * sizeof(MapLight)
+        + qint64(header->spawnCount) * sizeof(MapSpawn)
+        + qint64(header->widgetCount) * sizeof(MapWidget);
+
+    if (size < expected) {
+        m_errorString = QLatin1String("Truncated map file");
+        return;
+    }
+
+    const uchar *pos = data + sizeof(MapFileHeader);
+    m_tiles = reinterpret_cast<const char *>(pos);
+    pos += tilesSize(header->width, header->height);
+    m_lights = reinterpret_cast<const MapLight *>(pos);
+    pos += header->lightCount * sizeof(MapLight);
+    m_spawns = reinterpret_cast<const MapSpawn *>(pos);
+    pos += header->spawnCount * sizeof(MapSpawn);
+    m_widgets = reinterpret_cast<const MapWidget *>(pos);
+
+    // unknown types would collide without having any faces to draw
+    for (int i = 0; i < header->width * header->height; ++i) {
+        if (m_tiles[i] < TileMap::Empty || m_tiles[i] > TileMap::LastWallType) {
+            m_errorString = QLatin1String("Invalid tile type");
+            return;
+        }
+    }
+
+    for (uint i = 0; i < header->spawnCount; ++i) {
+        const MapSpawn &spawn = m_spawns[i];
+        // written so that NaN fails too
+        if (!(spawn.x >= 0 && spawn.x < header->width && spawn.y >= 0 && spawn.y < header->height)
+            || m_tiles[int(spawn.y) * header->width + int(spawn.x)] != TileMap::Empty)
+        {
+            m_errorString = QLatin1String("Spawn outside the map or inside a wall");
+            return;
+        }
+    }
+
+    m_header = header;
+}
+
+MapFile::~MapFile()
+{
+}
+
+TileMap MapFile::tileMap() const
+{
+    if (!m_header)
+        return TileMap();
+    return TileMap::fromRawData(m_tiles, m_header->width, m_header->height);
+}
+
+QPointF MapFile::startPos() const
+{
+    return m_header ? QPointF(m_header->startX, m_header->startY) : QPointF(1.5, 1.5);
+}
+
+qreal MapFile::startYaw() const
+{
+    return m_header ? m_header->startYaw : 0;
+}
+
+QVector<Light> MapFile::lights() const
+{
+    QVector<Light> lights;
+    if (!m_header)
+        return lights;
+
+    lights.reserve(m_header->lightCount);
+    for (uint i = 0; i < m_header->lightCount; ++i)
+        lights << Light(QPointF(m_lights[i].x, m_lights[i].y), m_lights[i].intensity);
+    return lights;
+}
+
+int MapFile::spawnCount() const
+{
+    return m_header ? m_header->spawnCount : 0;
+}
+
+int MapFile::widgetCount() const
+{
+    return m_header ? m_header->widgetCount : 0;
+}
+
+bool MapFile::save(const QString &fileName, const TileMap &map,
+                   const QPointF &startPos, qreal startYaw,
+                   const QVector<Light> &lights,
+                   const QVector<MapSpawn> &spawns,
+                   const QVector<MapWidget> &widgets)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    MapFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, mapMagic, sizeof(mapMagic));
+    header.version = mapVersion;
+    header.byteOrder = mapByteOrder;
+    header.width = map.width();
+    header.height = map.height();
+    header.startX = startPos.x();
+    header.startY = startPos.y();
+    header.startYaw = startYaw;
+    header.lightCount = lights.size();
+    header.spawnCount = spawns.size();
+    header.widgetCount = widgets.size();
+
+    QVector<MapLight> mapLights(lights.size());
+    for (int i = 0; i < lights.size(); ++i) {
+        mapLights[i].x = lights.at(i).pos().x();
+        mapLights[i].y = lights.at(i).pos().y();
+        mapLights[i].intensity = lights.at(i).intensity();
+    }
+
+    QByteArray tiles(map.data(), map.width() * map.height());
+    tiles.append(QByteArray(tilesSize(map.width(), map.height()) - tiles.size(), char(TileMap::Wall)));
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(tiles);
+    file.write(reinterpret_cast<const char *>(mapLights.constData()), mapLights.size() * sizeof(MapLight));
+    file.write(reinterpret_cast<const char *>(spawns.constData()), spawns.size() * sizeof(MapSpawn));
+    file.write(reinterpret_cast<const char *>(widgets.constData()), widgets.size() * sizeof(MapWidget));
+
+    return file.error() == QFile::NoError;
+}
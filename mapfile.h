@@ -0,0 +1,136 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <QFile>
+#include <QPointF>
+#include <QString>
+#include <QVector>
+
+#include "tilemap.h"
+
+class Light;
+
+struct MapLight
+{
+    float x;
+    float y;
+    float intensity;
+};
+
+struct MapSpawn
+{
+    float x;
+    float y;
+    float angle;
+};
+
+// places the widget of the given wall type on the face of an open cell
+struct MapWidget
+{
+    qint32 x;
+    qint32 y;
+    qint32 side;
+    qint32 type;
+};
+
+// Binary level file, memory mapped and read in place.
+//
+// Layout, all values in host byte order:
+//   header      MapFileHeader
+//   tiles       width * height signed bytes, padded to four bytes
+//   lights      lightCount * MapLight
+//   spawns      spawnCount * MapSpawn
+//   widgets     widgetCount * MapWidget
+class MapFile
+{
+public:
+    MapFile(const QString &fileName);
+    ~MapFile();
+
+    bool isValid() const { return m_header != 0; }
+    QString errorString() const { return m_errorString; }
+
+    // refers to the mapped data, only valid as long as the file is
+    TileMap tileMap() const;
+
+    QPointF startPos() const;
+    qreal startYaw() const;
+
+    QVector<Light> lights() const;
+
+    int spawnCount() const;
+    const MapSpawn *spawns() const { return m_spawns; }
+
+    int widgetCount() const;
+    const MapWidget *widgets() const { return m_widgets; }
+
+    static bool save(const QString &fileName, const TileMap &map,
+                     const QPointF &startPos, qreal startYaw,
+                     const QVector<Light> &lights,
+                     const QVector<MapSpawn> &spawns = QVector<MapSpawn>(),
+                     const QVector<MapWidget> &widgets = QVector<MapWidget>());
+
+private:
+    struct MapFileHeader
+    {
+        char magic[4];
+        quint32 version;
+        quint32 byteOrder;
+        qint32 width;
+        qint32 height;
+        float startX;
+        float startY;
+        float startYaw;
+        quint32 lightCount;
+        quint32 spawnCount;
+        quint32 widgetCount;
+        quint32 reserved;
+    };
+
+    static int tilesSize(int width, int height);
+
+    QFile m_file;
+    QString m_errorString;
+
+    const MapFileHeader *m_header;
+    const char *m_tiles;
+    const MapLight *m_lights;
+    const MapSpawn *m_spawns;
+    const MapWidget *m_widgets;
+};
+
+#endif
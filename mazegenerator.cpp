@@ -0,0 +1,308 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include "mazegenerator.h"
+
+#include <QSet>
+
+#include <qmath.h>
+
+static const int dx[] = { 0, 0, -1, 1 };
+static const int dy[] = { -1, 1, 0, 0 };
+
+MazeGenerator::MazeGenerator(int width, int height, uint seed)
+    : m_width(qMax(5, width))
+    , m_height(qMax(5, height))
+    , m_state(seed * 2654435761u + 0x9e3779b9u)
+    , m_wallDensity(0.8)
+    , m_doorCount(0)
+    , m_lightCount(0)
+    , m_entityCount(0)
+    , m_widgetCount(0)
+    , m_startPos(1.5, 1.5)
+    , m_startYaw(0)
+{
+    if (!m_state)
+        m_state = 1;
+}
+
+// xorshift, so that a seed gives the same maze on every platform
+quint32 MazeGenerator::random()
+{
+    m_state ^= m_state << 13;
+    m_state ^= m_state >> 17;
+    m_state ^= m_state << 5;
+    return m_state;
+}
+
+int MazeGenerator::random(int bound)
+{
+    return bound > 0 ? int(random() % quint32(bound)) : 0;
+}
+
+void MazeGenerator::generate()
+{
+    m_map = TileMap(m_width, m_height);
+    m_lights.clear();
+    m_spawns.clear();
+    m_widgets.clear();
+
+    carve();
+    removeWalls();
+    placeDoors();
+    placeLights();
+    placeEntities();
+    placeWidgets();
+}
+
+// Carves corridors between the cells at odd coordinates, leaving the
+// outer border and all cells at even coordinates as walls.
+void MazeGenerator::carve()
+{
+    const int cellsX = (m_width - 1) / 2;
+    const int cellsY = (m_height - 1) / 2;
+
+    QVector<bool> visited(cellsX * cellsY);
+    QVector<int> stack;
+
+    stack << 0;
+    visited[0] = true;
+    m_map.setType(1, 1, TileMap::Empty);
+
+    while (!stack.isEmpty()) {
+        const int cell = stack.last();
+        const int cx = cell % cellsX;
+        const int cy = cell / cellsX;
+
+        int directions[4];
+        int count = 0;
+        for (int i = 0; i < 4; ++i) {
+            const int nx = cx + dx[i];
+            const int ny = cy + dy[i];
+            if (nx >= 0 && ny >= 0 && nx < cellsX && ny < cellsY && !visited.at(ny * cellsX + nx))
+                directions[count++] = i;
+        }
+
+        if (!count) {
+            stack.pop_back();
+            continue;
+        }
+
+        const int direction = directions[random(count)];
+        const int nx = cx + dx[direction];
+        const int ny = cy + dy[direction];
+
+        visited[ny * cellsX + nx] = true;
+        m_map.setType(2 * cx + 1 + dx[direction], 2 * cy + 1 + dy[direction], TileMap::Empty);
+        m_map.setType(2 * nx + 1, 2 * ny + 1, TileMap::Empty);
+        stack << ny * cellsX + nx;
+    }
+
+    m_startPos = QPointF(1.5, 1.5);
+    // face along the first corridor, east or south
+    m_startYaw = m_map.type(2, 1) == TileMap::Empty ? 90 : 0;
+}
+
+// Knocks out walls between two corridor cells, which adds loops and makes
+// rooms once enough neighbouring walls are gone. Some of the remaining
+// walls get the book shelf texture.
+void MazeGenerator::removeWalls()
+{
+    const qreal removeChance = 1 - qBound(qreal(0), m_wallDensity, qreal(1));
+
+    for (int y = 1; y < m_height - 1; ++y) {
+        for (int x = 1; x < m_width - 1; ++x) {
+            if (m_map.type(x, y) != TileMap::Wall)
+                continue;
+
+            const bool betweenX = m_map.type(x - 1, y) == TileMap::Empty
+                                  && m_map.type(x + 1, y) == TileMap::Empty;
+            const bool betweenY = m_map.type(x, y - 1) == TileMap::Empty
+                                  && m_map.type(x, y + 1) == TileMap::Empty;
+
+            const qreal chance = random() / 4294967296.0;
+            if ((betweenX || betweenY) && chance < removeChance)
+                m_map.setType(x, y, TileMap::Empty);
+        }
+    }
+
+    for (int y = 0; y < m_height; ++y) {
+        for (int x = 0; x < m_width; ++x) {
+            if (m_map.type(x, y) == TileMap::Wall && random(8) == 0)
+                m_map.setType(x, y, 1);
+        }
+    }
+}
+
+QVector<int> MazeGenerator::openCells() const
+{
+    QVector<int> cells;
+    for (int y = 0; y < m_height; ++y) {
+        for (int x = 0; x < m_width; ++x) {
+            if (m_map.type(x, y) == TileMap::Empty)
+                cells << y * m_width + x;
+        }
+    }
+    return cells;
+}
+
+// puts doors in corridor cells with walls on two opposite sides, away
+// from the start cell so the player isn't trapped
+void MazeGenerator::placeDoors()
+{
+    QVector<int> candidates;
+    foreach (int cell, openCells()) {
+        const int x = cell % m_width;
+        const int y = cell / m_width;
+
+        if (x <= 2 && y <= 2)
+            continue;
+
+        const bool solidNS = m_map.type(x, y - 1) >= TileMap::Wall && m_map.type(x, y + 1) >= TileMap::Wall;
+        const bool solidWE = m_map.type(x - 1, y) >= TileMap::Wall && m_map.type(x + 1, y) >= TileMap::Wall;
+        const bool openNS = m_map.type(x, y - 1) == TileMap::Empty && m_map.type(x, y + 1) == TileMap::Empty;
+        const bool openWE = m_map.type(x - 1, y) == TileMap::Empty && m_map.type(x + 1, y) == TileMap::Empty;
+
+        if ((solidNS && openWE) || (solidWE && openNS))
+            candidates << cell;
+    }
+
+    for (int i = 0; i < m_doorCount && !candidates.isEmpty(); ++i) {
+        const int index = random(candidates.size());
+        const int cell = candidates.at(index);
+        candidates[index] = candidates.last();
+        candidates.pop_back();
+
+        const int x = cell % m_width;
+        const int y = cell / m_width;
+
+        // keep doors from being next to each other
+        bool adjacent = false;
+        for (int side = 0; side < 4; ++side)
+            adjacent = adjacent || m_map.type(x + dx[side], y + dy[side]) == TileMap::Door;
+
+        if (!adjacent)
+            m_map.setType(x, y, TileMap::Door);
+    }
+}
+
+void MazeGenerator::placeLights()
+{
+    const QVector<int> cells = openCells();
+    if (cells.isEmpty())
+        return;
+
+    for (int i = 0; i < m_lightCount; ++i) {
+        const int cell = cells.at(random(cells.size()));
+        const qreal intensity = 0.3 + 0.7 * (random() / 4294967296.0);
+        m_lights << Light(QPointF(cell % m_width + 0.5, cell / m_width + 0.5), intensity);
+    }
+}
+
+// puts each entity on its own open cell, away from the player's start
+void MazeGenerator::placeEntities()
+{
+    QVector<int> cells = openCells();
+    const int start = qFloor(m_startPos.y()) * m_width + qFloor(m_startPos.x());
+    const int startIndex = cells.indexOf(start);
+    if (startIndex >= 0)
+        cells.remove(startIndex);
+
+    for (int i = 0; i < m_entityCount && !cells.isEmpty(); ++i) {
+        // take the cell out by moving the last one into its place
+        const int index = random(cells.size());
+        const int cell = cells.at(index);
+        cells[index] = cells.last();
+        cells.resize(cells.size() - 1);
+
+        MapSpawn spawn;
+        spawn.x = cell % m_width + 0.5;
+        spawn.y = cell / m_width + 0.5;
+        spawn.angle = random(360);
+        m_spawns << spawn;
+    }
+}
+
+// puts each widget on a free wall face of a random open cell
+void MazeGenerator::placeWidgets()
+{
+    QVector<int> types;
+    foreach (int type, m_widgetTypes) {
+        if (type != 5)
+            types << type;
+    }
+    if (types.isEmpty())
+        return;
+
+    const QVector<int> cells = openCells();
+    if (cells.isEmpty())
+        return;
+
+    QSet<int> usedFaces;
+    const int maxAttempts = 16;
+
+    for (int i = 0; i < m_widgetCount; ++i) {
+        const int type = types.at(i % types.size());
+
+        for (int attempt = 0; attempt < maxAttempts; ++attempt) {
+            const int cell = cells.at(random(cells.size()));
+            const int side = random(4);
+            const int x = cell % m_width;
+            const int y = cell / m_width;
+
+            // the door opening button is only shown on north and south faces
+            if (type == 3 && side != TileMap::North && side != TileMap::South)
+                continue;
+
+            const int face = cell * 4 + side;
+            if (m_map.type(x + dx[side], y + dy[side]) < TileMap::Wall || usedFaces.contains(face))
+                continue;
+
+            MapWidget widget;
+            widget.x = x;
+            widget.y = y;
+            widget.side = side;
+            widget.type = type;
+            m_widgets << widget;
+
+            usedFaces.insert(face);
+            break;
+        }
+    }
+}
+
+bool MazeGenerator::save(const QString &fileName) const
+{
+    return MapFile::save(fileName, m_map, m_startPos, m_startYaw, m_lights, m_spawns, m_widgets);
+}
@@ -0,0 +1,113 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#ifndef MAZEGENERATOR_H
+#define MAZEGENERATOR_H
+
+#include <QPointF>
+#include <QString>
+#include <QVector>
+
+#include "mapfile.h"
+#include "mazescene.h"
+#include "tilemap.h"
+
+// Generates random mazes of any size for testing how the scene scales.
+// The result only depends on the seed and the settings.
+//
+// Corridors are carved with a depth first search, which gives a maze
+// without loops, then a share of the walls between two corridors is
+// knocked out according to the wall density. Doors are put in straight
+// corridor cells, and lights, entities and widgets on random open cells.
+class MazeGenerator
+{
+public:
+    MazeGenerator(int width, int height, uint seed = 1);
+
+    // fraction of the walls between corridors that are kept, 1 gives a
+    // perfect maze and 0 opens up everything but the pillars
+    void setWallDensity(qreal density) { m_wallDensity = density; }
+    void setDoorCount(int count) { m_doorCount = count; }
+    void setLightCount(int count) { m_lightCount = count; }
+    void setEntityCount(int count) { m_entityCount = count; }
+
+    // widget wall types, see WallItem, used in turn for each widget placed.
+    // Script widgets (type 5) are left out, their entity starts at a fixed
+    // spot of the built-in map that may be a wall or outside a generated one.
+    void setWidgetTypes(const QVector<int> &types) { m_widgetTypes = types; }
+    void setWidgetCount(int count) { m_widgetCount = count; }
+
+    void generate();
+
+    const TileMap &map() const { return m_map; }
+    QPointF startPos() const { return m_startPos; }
+    qreal startYaw() const { return m_startYaw; }
+    QVector<Light> lights() const { return m_lights; }
+    QVector<MapSpawn> spawns() const { return m_spawns; }
+    QVector<MapWidget> widgets() const { return m_widgets; }
+
+    bool save(const QString &fileName) const;
+
+private:
+    void carve();
+    void removeWalls();
+    void placeDoors();
+    void placeLights();
+    void placeEntities();
+    void placeWidgets();
+
+    QVector<int> openCells() const;
+    quint32 random();
+    int random(int bound);
+
+    int m_width;
+    int m_height;
+    quint32 m_state;
+
+    qreal m_wallDensity;
+    int m_doorCount;
+    int m_lightCount;
+    int m_entityCount;
+    int m_widgetCount;
+    QVector<int> m_widgetTypes;
+
+    TileMap m_map;
+    QPointF m_startPos;
+    qreal m_startYaw;
+    QVector<Light> m_lights;
+    QVector<MapSpawn> m_spawns;
+    QVector<MapWidget> m_widgets;
+};
+
+#endif
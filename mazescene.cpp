@@ -36,25 +36,39 @@ POSSIBILITY OF SUCH DAMAGE."
 
 #include <QCheckBox>
 #include <QComboBox>
+#include <QEasingCurve>
 #include <QGraphicsProxyWidget>
 #include <QPainter>
 #include <QPushButton>
 #include <QKeyEvent>
 #include <QTimer>
+#include <QVarLengthArray>
 #include <QVBoxLayout>
 #if 0
 #include <QWebView>
 #endif
 #include <QGraphicsWebView>
 
+#ifndef QT_NO_CONCURRENT
+#include <QtConcurrentMap>
+#include <QFutureWatcher>
+#endif
+
 #include <qmath.h>
 #include <qdebug.h>
 
-#include <limits>
-
 #include "scriptwidget.h"
 #include "entity.h"
+#include "fieldofview.h"
 #include "modelitem.h"
+#include "mapfile.h"
+#include "frameprofiler.h"
+#include "tracerecorder.h"
+#include "glrenderer.h"
+#include "columnrenderer.h"
+#include "floorrenderer.h"
+#include "simulation.h"
+#include "framedriver.h"
 
 #include <QVector3D>
 
@@ -100,12 +114,24 @@ void View::paintEvent(QPaintEvent *event)
         m_firstPaint = false;
     }
 
-    QGraphicsView::paintEvent(event);
+    {
+        ProfileScope scope(FrameProfiler::Paint, !graphicsProxyWidget());
+        TraceScope trace("paint", "render");
+        QGraphicsView::paintEvent(event);
+    }
+
+    // views embedded in the scene are painted as part of the outer frame
+    if (!graphicsProxyWidget())
+        FrameProfiler::instance()->endFrame();
+
+    if (m_scene)
+        m_scene->framePresented();
 }
 
-Light::Light(const QPointF &pos, qreal intensity)
+Light::Light(const QPointF &pos, qreal intensity, qreal radius)
     : m_pos(pos)
     , m_intensity(intensity)
+    , m_radius(radius)
 {
 }
 
@@ -115,8 +141,24 @@ qreal Light::intensityAt(const QPointF &pos) const
     const qreal linearIntensity = 30 * m_intensity;
 
     const qreal d = QLineF(m_pos, pos).length();
-    return quadraticIntensity / (d * d)
+    const qreal intensity = quadraticIntensity / (d * d)
         + linearIntensity / d;
+
+    if (m_radius <= 0)
+        return intensity;
+    if (d >= m_radius)
+        return 0;
+
+    const qreal f = 1 - (d * d) / (m_radius * m_radius);
+    return intensity * f * f;
+}
+
+qreal Light::reach() const
+{
+    // solves 150 i / d^2 + 30 i / d = 1 for d
+    const qreal i = qMax(qreal(0), m_intensity);
+    const qreal cutoff = (30 * i + qSqrt(900 * i * i + 600 * i)) / 2;
+    return m_radius > 0 ? qMin(m_radius, cutoff) : cutoff;
 }
 
 QMatrix4x4 fromRotation(float angle, Qt::Axis axis)
@@ -198,6 +240,7 @@ void WalkingItem::mousePressEvent(QGraphicsSceneMouseEvent *event)
 {
     event->accept();
     m_walking = !m_walking;
+    m_scene->setAutoWalking(m_walking);
     updatePixmap();
 }
 
@@ -209,75 +252,136 @@ void WalkingItem::updatePixmap()
         setPixmap(m_standingPixmap);
 }
 
-MazeScene::MazeScene(const QVector<Light> &lights, const char *map, int width, int height)
-    : m_lights(lights)
+MazeScene::MazeScene(const QVector<Light> &lights, const TileMap &map, MapFile *file)
+    : m_mapFile(file)
+    , m_map(map)
+    , m_lights(lights)
+#ifdef USE_GL_RENDERER
+    , m_glRenderer(0)
+#endif
+    , m_columnRenderer(0)
+    , m_softwareRendering(false)
+    , m_floorRenderer(0)
+#ifndef QT_NO_CONCURRENT
+    , m_visibleSetWatcher(0)
+#endif
+    , m_visibilityMode(SpanVisibility)
+    , m_visibilityFrame(0)
+    , m_rayCount(256)
+    , m_screenExtent(2)
+    , m_doorValue(1)
+    , m_simulation(0)
+    , m_frameDriver(0)
     , m_walkingVelocity(0)
     , m_strafingVelocity(0)
     , m_turningSpeed(0)
     , m_pitchSpeed(0)
+    , m_autoWalking(false)
     , m_deltaYaw(0)
     , m_deltaPitch(0)
+    , m_doorProgress(1)
+    , m_doorDirection(1)
     , m_simulationTime(0)
     , m_walkTime(0)
-    , m_width(width)
-    , m_height(height)
+    , m_animationTime(0)
+    , m_width(map.width())
+    , m_height(map.height())
     , m_player(0)
     , m_accelerated(false)
-{
-    m_camera.setPos(QPointF(1.5, 1.5));
-    m_camera.setYaw(0.1);
-
-    m_doorAnimation = new QTimeLine(1000, this);
-    m_doorAnimation->setUpdateInterval(20);
-    connect(m_doorAnimation, SIGNAL(valueChanged(qreal)), this, SLOT(moveDoors(qreal)));
-
-    QMap<char, int> types;
-    types[' '] = -2;
-    types['-'] = -1;
-    types['#'] = 0;
-    types['&'] = 1;
-    types['@'] = 2;
-    types['%'] = 3;
-    types['$'] = 4;
-    types['?'] = 5;
-    types['!'] = 6;
-    types['='] = 7;
-    types['*'] = 8;
-    types['/'] = 9;
-    types['.'] = 10;
-
-    int type;
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            type = types[map[y*width+x]];
-            if (type >= 0)
-                continue;
+    , m_lightOcclusion(true)
+    , m_lightGrid(map.width(), map.height())
+    , m_torchLight(-1)
+{
+    const int width = m_width;
+    const int height = m_height;
+
+    QHash<int, int> widgets;
+    if (file) {
+        m_camera.setPos(file->startPos());
+        m_camera.setYaw(file->startYaw());
+
+        for (int i = 0; i < file->widgetCount(); ++i) {
+            const MapWidget &widget = file->widgets()[i];
+            if (m_map.contains(widget.x, widget.y) && widget.side >= 0 && widget.side < 4)
+                widgets.insert(faceIndex(widget.x, widget.y, widget.side), widget.type);
+        }
+    } else {
+        m_camera.setPos(QPointF(1.5, 1.5));
+        m_camera.setYaw(0.1);
+    }
+    m_simulatedCamera = m_camera;
+    m_previousCamera = m_camera;
+
+    m_faces.resize(width * height * 4);
+    m_cellStamps.resize(width * height);
+
+    buildCollisionMap();
+
+    // merge runs of plain faces along rows and columns into single walls,
+    // the wall batches split them again where an item sorts between cells
+    for (int side = 0; side < 4; ++side) {
+        const bool horizontal = side == TileMap::North || side == TileMap::South;
+        const int lines = horizontal ? height : width;
+        const int length = horizontal ? width : height;
+
+        for (int line = 0; line < lines; ++line) {
+            int i = 0;
+            while (i < length) {
+                const int x = horizontal ? i : line;
+                const int y = horizontal ? line : i;
+
+                const int type = faceType(x, y, side);
+                if (type == TileMap::Empty) {
+                    ++i;
+                    continue;
+                }
 
-            type = types[map[(y-1)*width+x]];
-            if (type >= -1)
-                addWall(QPointF(x, y), QPointF(x+1, y), type);
+                const int face = faceIndex(x, y, side);
+                if (widgets.contains(face)) {
+                    addWallRun(x, y, side, 1, widgets.value(face));
+                    ++i;
+                    continue;
+                }
 
-            type = types[map[(y+1)*width+x]];
-            if (type >= -1)
-                addWall(QPointF(x+1, y+1), QPointF(x, y+1), type);
+                int run = 1;
+                if (isPlainWallType(type)) {
+                    while (i + run < length) {
+                        const int nx = horizontal ? i + run : line;
+                        const int ny = horizontal ? line : i + run;
+                        if (faceType(nx, ny, side) != type || widgets.contains(faceIndex(nx, ny, side)))
+                            break;
+                        ++run;
+                    }
+                }
 
-            type = types[map[y*width+x-1]];
-            if (type >= -1)
-                addWall(QPointF(x, y+1), QPointF(x, y), type);
+                addWallRun(x, y, side, run, type);
+                i += run;
+            }
+        }
+    }
 
-            type = types[map[y*width+x+1]];
-            if (type >= -1)
-                addWall(QPointF(x+1, y), QPointF(x+1, y+1), type);
+    if (file) {
+        for (int i = 0; i < file->spawnCount(); ++i) {
+            const MapSpawn &spawn = file->spawns()[i];
+            addEntity(new Entity(QPointF(spawn.x, spawn.y), spawn.angle));
         }
     }
 
-    QTimer *timer = new QTimer(this);
-    timer->setInterval(20);
-    timer->start();
-    connect(timer, SIGNAL(timeout()), this, SLOT(move()));
+    buildVisibleSets();
+
+#ifdef USE_GL_RENDERER
+    m_glRenderer = new GLRenderer(m_map, m_batchedWalls);
+#endif
+    m_columnRenderer = new ColumnRenderer(this);
+    m_floorRenderer = new FloorRenderer(m_map);
+
+    m_frameDriver = new FrameDriver(this);
+    m_frameDriver->requestFrame();
 
     m_time.start();
     updateTransforms();
+    buildWallCells();
+    bakeLighting();
     updateRenderer();
 
     m_walkingItem = new WalkingItem(this);
@@ -285,13 +389,55 @@ MazeScene::MazeScene(const QVector<Light> &lights, const char *map, int width, i
     m_walkingItem->setZValue(100000);
 
     addItem(m_walkingItem);
+
+    m_profilerItem = new ProfilerItem;
+    m_profilerItem->setZValue(100000);
+    addItem(m_profilerItem);
+}
+
+MazeScene::~MazeScene()
+{
+#ifndef QT_NO_CONCURRENT
+    // the builders read the map and faces
+    if (m_visibleSetWatcher) {
+        m_visibleSetWatcher->cancel();
+        m_visibleSetWatcher->waitForFinished();
+    }
+#endif
+    delete m_simulation;
+#ifdef USE_GL_RENDERER
+    delete m_glRenderer;
+#endif
+    delete m_columnRenderer;
+    delete m_floorRenderer;
+    qDeleteAll(m_batchedWalls);
+    delete m_mapFile;
+}
+
+// scenes shown in a view inside another scene don't own the profiler counters
+bool MazeScene::isEmbedded() const
+{
+    return views().isEmpty() || views().first()->graphicsProxyWidget();
+}
+
+MazeScene *MazeScene::load(const QString &fileName)
+{
+    MapFile *file = new MapFile(fileName);
+    if (!file->isValid()) {
+        qWarning() << "Failed to load map" << fileName << ":" << file->errorString();
+        delete file;
+        return 0;
+    }
+
+    return new MazeScene(file->lights(), file->tileMap(), file);
 }
 
 void MazeScene::setAcceleratedViewport(bool accelerated)
 {
     m_accelerated = accelerated;
 
-    if (!accelerated)
+    // software rendering is meant for the raster viewport
+    if (!accelerated && !m_softwareRendering)
         QTimer::singleShot(0, this, SLOT(toggleRenderer()));
 
     updateRenderer();
@@ -303,15 +449,92 @@ void MazeScene::viewResized(QGraphicsView *view)
     QPointF bottomLeft = view->mapToScene(QPoint(5, view->height() - 5));
 
     m_walkingItem->setPos(bottomLeft.x(), bottomLeft.y() - bounds.height());
+    m_profilerItem->setPos(view->mapToScene(QPoint(5, 5)));
+
+    // horizontal extent of the visible scene, used to aim the rays
+    // when using raycast visibility
+    const QRectF visible = view->mapToScene(view->viewport()->rect()).boundingRect();
+    m_screenExtent = qMax(qAbs(visible.left()), qAbs(visible.right()));
+    m_rayCount = qMax(64, view->width() / 2);
+}
+
+void MazeScene::setVisibilityMode(VisibilityMode mode)
+{
+    if (m_visibilityMode == mode)
+        return;
+
+    m_visibilityMode = mode;
+    updateTransforms();
 }
 
 void MazeScene::addProjectedItem(ProjectedItem *item)
 {
     addItem(item);
     m_projectedItems << item;
+    m_dynamicItems << item;
+
+    // keep the item hidden until the next visibility pass finds it
+    item->setObscured(true);
+    item->updateTransform(m_camera);
+}
+
+// the type of the wall on the given side of an open cell, or Empty if
+// there is no wall there
+int MazeScene::faceType(int x, int y, int side) const
+{
+    static const int dx[] = { 0, 0, -1, 1 };
+    static const int dy[] = { -1, 1, 0, 0 };
+
+    if (m_map.type(x, y) >= TileMap::Wall)
+        return TileMap::Empty;
+
+    const int type = m_map.type(x + dx[side], y + dy[side]);
+    return type >= TileMap::Door ? type : TileMap::Empty;
+}
+
+// wall types that are only textured, without doors, widgets or entities
+bool MazeScene::isPlainWallType(int type)
+{
+    return type == 0 || type == 1 || type == 2 || type == 6;
+}
+
+// adds a single wall covering the given side of length cells, starting
+// at (x, y) and going right for horizontal sides and down for vertical
+void MazeScene::addWallRun(int x, int y, int side, int length, int type)
+{
+    QPointF a;
+    QPointF b;
+    switch (side) {
+    case TileMap::North:
+        a = QPointF(x, y);
+        b = QPointF(x + length, y);
+        break;
+    case TileMap::South:
+        a = QPointF(x + length, y + 1);
+        b = QPointF(x, y + 1);
+        break;
+    case TileMap::West:
+        a = QPointF(x, y + length);
+        b = QPointF(x, y);
+        break;
+    case TileMap::East:
+        a = QPointF(x + 1, y);
+        b = QPointF(x + 1, y + length);
+        break;
+    }
+
+    WallItem *item = addWall(a, b, type);
+
+    const bool horizontal = side == TileMap::North || side == TileMap::South;
+    for (int i = 0; i < length; ++i) {
+        if (horizontal)
+            m_faces[faceIndex(x + i, y, side)] = item;
+        else
+            m_faces[faceIndex(x, y + i, side)] = item;
+    }
 }
 
-void MazeScene::addWall(const QPointF &a, const QPointF &b, int type)
+WallItem *MazeScene::addWall(const QPointF &a, const QPointF &b, int type)
 {
     WallItem *item = new WallItem(this, a, b, type);
 #ifdef USE_PHONON
@@ -330,7 +553,15 @@ void MazeScene::addWall(const QPointF &a, const QPointF &b, int type)
     }
 #endif
     item->setVisible(false);
-    addProjectedItem(item);
+    // hidden until a visibility pass finds it, like addProjectedItem()
+    item->setObscured(true);
+    if (item->isBatchable()) {
+        item->setBatchIndex(m_batchedWalls.size());
+        m_batchedWalls << item;
+    } else {
+        addItem(item);
+    }
+    m_projectedItems << item;
     m_walls << item;
 
     if (type == -1)
@@ -342,7 +573,10 @@ void MazeScene::addWall(const QPointF &a, const QPointF &b, int type)
         QPushButton *button = qobject_cast<QPushButton *>(widget);
         if (button)
             m_buttons << button;
+        m_widgetWalls << item;
     }
+
+    return item;
 }
 
 void MazeScene::loadFinished()
@@ -426,6 +660,26 @@ void Camera::updateMatrix() const
 
 void MazeScene::drawBackground(QPainter *painter, const QRectF &)
 {
+    ProfileScope scope(FrameProfiler::DrawBackground, !isEmbedded());
+
+#ifdef USE_GL_RENDERER
+    if (m_glRenderer->isUsable(painter)) {
+        m_glRenderer->drawFloorAndCeiling(painter, m_camera);
+        return;
+    }
+#endif
+
+    if (isSoftwareRendered(painter)) {
+        m_columnRenderer->render(painter, m_camera);
+        return;
+    }
+
+    // projective brush fills are slow on the raster engine
+    if (painter->paintEngine() && painter->paintEngine()->type() == QPaintEngine::Raster) {
+        m_floorRenderer->render(painter, m_camera);
+        return;
+    }
+
     static QImage floor = QImage("floor.png").convertToFormat(QImage::Format_RGB32);
     QBrush floorBrush(floor);
 
@@ -460,24 +714,45 @@ void MazeScene::drawBackground(QPainter *painter, const QRectF &)
     painter->restore();
 }
 
+void MazeScene::drawForeground(QPainter *painter, const QRectF &)
+{
+    if (isSoftwareRendered(painter))
+        m_columnRenderer->drawOccluders(painter, m_visibleItems);
+}
+
+void MazeScene::setSoftwareRendering(bool enabled)
+{
+    m_softwareRendering = enabled;
+    update();
+}
+
+bool MazeScene::isSoftwareRendered(QPainter *painter) const
+{
+    if (!m_softwareRendering)
+        return false;
+
+    const QPaintEngine *engine = painter->paintEngine();
+    return !engine || (engine->type() != QPaintEngine::OpenGL
+                       && engine->type() != QPaintEngine::OpenGL2);
+}
+
 void MazeScene::addEntity(Entity *entity)
 {
     addProjectedItem(entity);
+
+    QMutexLocker locker(&m_simulationLock);
     m_entities << entity;
+    m_entityCells.insert(cellKey(entity->pos()), entity);
 }
 
-ProjectedItem::ProjectedItem(const QRectF &bounds, bool shadow, bool opaque)
+ProjectedItem::ProjectedItem(const QRectF &bounds, bool opaque)
     : m_bounds(bounds)
-    , m_shadowItem(0)
     , m_opaque(opaque)
     , m_obscured(false)
+    , m_batchIndex(-1)
+    , m_projected(false)
+    , m_depth(0)
 {
-    if (shadow) {
-        m_shadowItem = new QGraphicsRectItem(bounds, this);
-        m_shadowItem->setPen(Qt::NoPen);
-        m_shadowItem->setZValue(10);
-    }
-
     m_targetRect = m_bounds;
 }
 
@@ -497,12 +772,6 @@ void ProjectedItem::setPosition(const QPointF &a, const QPointF &b)
     m_b = b;
 }
 
-void ProjectedItem::setLightingEnabled(bool enable)
-{
-    if (m_shadowItem)
-        m_shadowItem->setVisible(enable);
-}
-
 class ProxyWidget : public QGraphicsProxyWidget
 {
 public:
@@ -511,6 +780,12 @@ public:
     {
     }
 
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+    {
+        ProfileScope scope(FrameProfiler::ProxyWidgets);
+        QGraphicsProxyWidget::paint(painter, option, widget);
+    }
+
 protected:
     QVariant itemChange(GraphicsItemChange change, const QVariant & value)
     {
@@ -524,8 +799,35 @@ protected:
 };
 
 
+static inline QRectF wallBounds(const QPointF &a, const QPointF &b)
+{
+    const qreal length = QLineF(a, b).length();
+    return QRectF(-length / 2, -0.5, length, 1.0);
+}
+
+// the texture repeated horizontally, once for each unit of wall length
+static QImage repeatedImage(const QImage &image, int count)
+{
+    if (count <= 1)
+        return image;
+
+    static QHash<QPair<qint64, int>, QImage> cache;
+    const QPair<qint64, int> key(image.cacheKey(), count);
+    if (cache.contains(key))
+        return cache.value(key);
+
+    QImage result(image.width() * count, image.height(), image.format());
+    QPainter p(&result);
+    for (int i = 0; i < count; ++i)
+        p.drawImage(i * image.width(), 0, image);
+    p.end();
+
+    cache.insert(key, result);
+    return result;
+}
+
 WallItem::WallItem(MazeScene *scene, const QPointF &a, const QPointF &b, int type)
-    : ProjectedItem(QRectF(-0.5, -0.5, 1.0, 1.0))
+    : ProjectedItem(wallBounds(a, b))
     , m_type(type)
 {
     setPosition(a, b);
@@ -534,20 +836,26 @@ WallItem::WallItem(MazeScene *scene, const QPointF &a, const QPointF &b, int typ
     static QImage book = QImage("book.png").convertToFormat(QImage::Format_RGB32);
     static QImage door = QImage("door.png").convertToFormat(QImage::Format_RGB32);
 
+    const int repeat = qMax(1, qRound(QLineF(a, b).length()));
+
     switch (type) {
     case -1:
-        setImage(door);
+        m_texture = door;
         break;
     case 1:
-        setImage(book);
+        m_texture = repeatedImage(book, repeat);
         break;
     case 2:
+        // see-through, only darkens what is behind it
         setOpaque(false);
+        m_texture = QImage(4, 4, QImage::Format_ARGB32_Premultiplied);
+        m_texture.fill(qRgba(0, 0, 0, 100));
         break;
     default:
-        setImage(brown);
+        m_texture = repeatedImage(brown, repeat);
         break;
     }
+    setImage(m_texture);
 
     m_scale = 0.8;
 
@@ -648,6 +956,48 @@ bool MazeScene::eventFilter(QObject *target, QEvent *event)
     return false;
 }
 
+void WallItem::bakeLighting(const QVector<int> &shadows)
+{
+    if (m_texture.isNull() || shadows.size() < 2)
+        return;
+
+    // walls away from the lights are evenly lit, share their images
+    bool uniform = true;
+    for (int i = 1; i < shadows.size(); ++i)
+        uniform = uniform && shadows.at(i) == shadows.at(0);
+
+    static QHash<QPair<qint64, int>, QImage> cache;
+    const QPair<qint64, int> key(m_texture.cacheKey(), shadows.at(0));
+    if (uniform && cache.contains(key)) {
+        setImage(cache.value(key));
+        return;
+    }
+
+    QImage image = m_texture.convertToFormat(QImage::Format_RGB32);
+    const int width = image.width();
+    const int segments = shadows.size() - 1;
+
+    // the texture runs from b to a like the samples
+    QVector<int> alphas(width);
+    for (int x = 0; x < width; ++x) {
+        const qreal pos = segments * (x + qreal(0.5)) / width;
+        const int i = qMin(int(pos), segments - 1);
+        alphas[x] = int(shadows.at(i) + (shadows.at(i + 1) - shadows.at(i)) * (pos - i));
+    }
+
+    for (int y = 0; y < image.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            const int s = 255 - alphas.at(x);
+            line[x] = qRgb(qRed(line[x]) * s / 255, qGreen(line[x]) * s / 255, qBlue(line[x]) * s / 255);
+        }
+    }
+
+    if (uniform)
+        cache.insert(key, image);
+    setImage(image);
+}
+
 void WallItem::childResized()
 {
     QRectF rect = m_childItem->boundingRect();
@@ -665,51 +1015,41 @@ void WallItem::childResized()
     m_childItem->setCacheMode(QGraphicsItem::ItemCoordinateCache);
 }
 
-void ProjectedItem::updateLighting(const QVector<Light> &lights, bool useConstantLight)
+QRectF ProjectedItem::boundingRect() const
 {
-    if (!m_shadowItem)
-        return;
-
-    if (useConstantLight) {
-        m_shadowItem->setBrush(QColor(0, 0, 0, 100));
-        return;
-    }
-
-    const qreal constantIntensity = 80;
-    qreal la = constantIntensity;
-    qreal lb = constantIntensity;
-    foreach (const Light &light, lights) {
-        la += light.intensityAt(m_b);
-        lb += light.intensityAt(m_a);
-    }
-
-    int va = qMax(0, 255 - int(la));
-    int vb = qMax(0, 255 - int(lb));
-
-    if (va == vb) {
-        m_shadowItem->setBrush(QColor(0, 0, 0, va));
-    } else {
-        const QRectF rect = boundingRect();
-        QLinearGradient g(rect.topLeft(), rect.topRight());
-
-        g.setColorAt(0, QColor(0, 0, 0, va));
-        g.setColorAt(1, QColor(0, 0, 0, vb));
+    return m_bounds;
+}
 
-        m_shadowItem->setBrush(g);
+void ProjectedItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
+{
+    if (!m_image.isNull()) {
+        // doors slide by shrinking the target rect from the left
+        const qreal visible = m_targetRect.width() / m_bounds.width();
+        QRectF source = QRectF(0, 0, m_image.width() * visible, m_image.height());
+        painter->drawImage(m_targetRect, m_image, source);
     }
 }
 
-QRectF ProjectedItem::boundingRect() const
+int ProjectedItem::cellCount() const
 {
-    return m_bounds;
+    return qMax(1, qRound(QLineF(m_a, m_b).length()));
 }
 
-void ProjectedItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
+void ProjectedItem::paintCells(QPainter *painter, int first, int count)
 {
+    const int cells = cellCount();
+    if (first == 0 && count == cells) {
+        paint(painter, 0, 0);
+        return;
+    }
+
+    // only merged walls are split, and those are never sliding doors
     if (!m_image.isNull()) {
-        QRectF target = m_targetRect.translated(0.5, 0.5);
-        QRectF source = QRectF(0, 0, m_image.width() * (1 - target.x()), m_image.height());
-        painter->drawImage(m_targetRect, m_image, source);
+        const qreal width = m_bounds.width() / cells;
+        const qreal imageWidth = qreal(m_image.width()) / cells;
+        const QRectF target(m_bounds.left() + first * width, m_bounds.top(), count * width, m_bounds.height());
+        const QRectF source(first * imageWidth, 0, count * imageWidth, m_image.height());
+        painter->drawImage(target, m_image, source);
     }
 }
 
@@ -719,13 +1059,14 @@ void ProjectedItem::setAnimationTime(qreal time)
     QRectF rect = boundingRect();
     m_targetRect = QRectF(QPointF(rect.left() + rect.width() * time, rect.top()),
                           rect.bottomRight());
-    if (m_shadowItem)
-        m_shadowItem->setRect(m_targetRect);
     update();
 }
 
 void ProjectedItem::setImage(const QImage &image)
 {
+    if (image.cacheKey() == m_image.cacheKey())
+        return;
+
     m_image = image;
     update();
 }
@@ -740,6 +1081,65 @@ bool ProjectedItem::isObscured() const
     return m_obscured;
 }
 
+void ProjectedItem::setBatchIndex(int index)
+{
+    m_batchIndex = index;
+    m_projected = false;
+}
+
+WallBatchItem::WallBatchItem(MazeScene *scene)
+    : m_scene(scene)
+{
+}
+
+void WallBatchItem::setWalls(const QVector<WallPiece> &walls)
+{
+    if (walls.isEmpty() && m_walls.isEmpty())
+        return;
+
+    QRectF bounds;
+    foreach (const WallPiece &piece, walls)
+        bounds |= piece.wall->projection().mapRect(piece.wall->boundingRect());
+
+    // walls partly behind the camera can project very far out
+    bounds &= QRectF(-100, -100, 200, 200);
+
+    if (bounds != m_bounds) {
+        prepareGeometryChange();
+        m_bounds = bounds;
+    }
+
+    m_walls = walls;
+    update();
+}
+
+QRectF WallBatchItem::boundingRect() const
+{
+    return m_bounds;
+}
+
+void WallBatchItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
+{
+    // the column renderer already drew these into the background
+    if (m_scene->isSoftwareRendered(painter))
+        return;
+
+#ifdef USE_GL_RENDERER
+    GLRenderer *renderer = m_scene->glRenderer();
+    if (renderer->isUsable(painter)) {
+        renderer->drawWalls(painter, m_scene->camera(), m_walls);
+        return;
+    }
+#endif
+
+    const QTransform base = painter->transform();
+    foreach (const WallPiece &piece, m_walls) {
+        painter->setTransform(piece.wall->projection() * base);
+        piece.wall->paintCells(painter, piece.first, piece.count);
+    }
+    painter->setTransform(base);
+}
+
 void ProjectedItem::updateTransform(const Camera &camera)
 {
     if (!m_obscured) {
@@ -758,6 +1158,13 @@ void ProjectedItem::updateTransform(const Camera &camera)
 
             qreal zm = QLineF(camera.pos(), center).length();
 
+            if (isBatched()) {
+                m_projected = true;
+                m_depth = -zm;
+                m_projection = m.toTransform(0);
+                return;
+            }
+
             setVisible(true);
             setZValue(-zm);
             setTransform(m.toTransform(0));
@@ -765,6 +1172,11 @@ void ProjectedItem::updateTransform(const Camera &camera)
         }
     }
 
+    if (isBatched()) {
+        m_projected = false;
+        return;
+    }
+
     // hide the item by placing it far outside the scene
     // we could use setVisible() but that causes unnecessary
     // update to cahced items
@@ -783,8 +1195,12 @@ void MazeScene::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
 
     if (event->buttons() & Qt::LeftButton) {
         QPointF delta(event->scenePos() - event->lastScenePos());
-        m_deltaYaw += delta.x() * 80;
-        m_deltaPitch -= delta.y() * 80;
+        {
+            QMutexLocker locker(&m_simulationLock);
+            m_deltaYaw += delta.x() * 80;
+            m_deltaPitch -= delta.y() * 80;
+        }
+        requestFrame();
     }
 }
 
@@ -792,6 +1208,7 @@ void MazeScene::keyPressEvent(QKeyEvent *event)
 {
     if (handleKey(event->key(), true)) {
         event->accept();
+        requestFrame();
         return;
     }
 
@@ -802,6 +1219,7 @@ void MazeScene::keyReleaseEvent(QKeyEvent *event)
 {
     if (handleKey(event->key(), false)) {
         event->accept();
+        requestFrame();
         return;
     }
 
@@ -816,29 +1234,68 @@ bool MazeScene::handleKey(int key, bool pressed)
     switch (key) {
     case Qt::Key_Left:
     case Qt::Key_Q:
-        m_turningSpeed = (pressed ? -0.5 : 0.0);
+        setSimulationInput(&m_turningSpeed, pressed ? -0.5 : 0.0);
         return true;
     case Qt::Key_Right:
     case Qt::Key_E:
-        m_turningSpeed = (pressed ? 0.5 : 0.0);
+        setSimulationInput(&m_turningSpeed, pressed ? 0.5 : 0.0);
         return true;
     case Qt::Key_Down:
-        m_pitchSpeed = (pressed ? 0.5 : 0.0);
+        setSimulationInput(&m_pitchSpeed, pressed ? 0.5 : 0.0);
         return true;
     case Qt::Key_Up:
-        m_pitchSpeed = (pressed ? -0.5 : 0.0);
+        setSimulationInput(&m_pitchSpeed, pressed ? -0.5 : 0.0);
         return true;
     case Qt::Key_S:
-        m_walkingVelocity = (pressed ? -0.01 : 0.0);
+        setSimulationInput(&m_walkingVelocity, pressed ? -0.01 : 0.0);
         return true;
     case Qt::Key_W:
-        m_walkingVelocity = (pressed ? 0.01 : 0.0);
+        setSimulationInput(&m_walkingVelocity, pressed ? 0.01 : 0.0);
         return true;
     case Qt::Key_A:
-        m_strafingVelocity = (pressed ? -0.01 : 0.0);
+        setSimulationInput(&m_strafingVelocity, pressed ? -0.01 : 0.0);
         return true;
     case Qt::Key_D:
-        m_strafingVelocity = (pressed ? 0.01 : 0.0);
+        setSimulationInput(&m_strafingVelocity, pressed ? 0.01 : 0.0);
+        return true;
+    case Qt::Key_R:
+        if (pressed)
+            setSoftwareRendering(!m_softwareRendering);
+        return true;
+    case Qt::Key_L:
+        if (pressed) {
+            m_floorRenderer->setLightingEnabled(!m_floorRenderer->isLightingEnabled());
+            update();
+        }
+        return true;
+    case Qt::Key_F:
+        if (pressed) {
+            if (m_torchLight >= 0) {
+                removeDynamicLight(m_torchLight);
+                m_torchLight = -1;
+            } else {
+                m_torchLight = addDynamicLight(Light(m_camera.pos(), 0.4, 3));
+            }
+        }
+        return true;
+    case Qt::Key_V:
+        if (pressed)
+            setVisibilityMode(m_visibilityMode == SpanVisibility ? RaycastVisibility : SpanVisibility);
+        return true;
+    case Qt::Key_P:
+        if (pressed) {
+            m_profilerItem->setVisible(!m_profilerItem->isVisible());
+            FrameProfiler::instance()->setEnabled(m_profilerItem->isVisible());
+        }
+        return true;
+    case Qt::Key_T:
+        if (pressed) {
+            TraceRecorder *recorder = TraceRecorder::instance();
+            if (TraceRecorder::isRecording())
+                recorder->stop();
+            else
+                recorder->start(TraceRecorder::defaultFileName());
+        }
         return true;
     }
 
@@ -850,36 +1307,85 @@ static inline QRectF rectFromPoint(const QPointF &point, qreal size)
     return QRectF(point, point).adjusted(-size/2, -size/2, size/2, size/2);
 }
 
+void MazeScene::buildCollisionMap()
+{
+    m_collisionMap.resize(m_width * m_height);
+    for (int y = 0; y < m_height; ++y) {
+        for (int x = 0; x < m_width; ++x) {
+            const int type = m_map.type(x, y);
+
+            CollisionType collision = Solid;
+            if (type == TileMap::Empty || type == 6)
+                collision = Free;
+            else if (type == TileMap::Door)
+                collision = DoorCell;
+
+            m_collisionMap[y * m_width + x] = collision;
+        }
+    }
+}
+
+int MazeScene::cellKey(const QPointF &pos) const
+{
+    const int x = qBound(0, qFloor(pos.x()), m_width - 1);
+    const int y = qBound(0, qFloor(pos.y()), m_height - 1);
+    return y * m_width + x;
+}
+
+// called from the simulation with m_simulationLock held
+void MazeScene::updateEntityCell(Entity *entity, const QPointF &oldPos)
+{
+    const int oldKey = cellKey(oldPos);
+    const int key = cellKey(entity->pos());
+    if (oldKey == key)
+        return;
+
+    m_entityCells.remove(oldKey, entity);
+    m_entityCells.insert(key, entity);
+}
+
 bool MazeScene::blocked(const QPointF &pos, Entity *me) const
 {
     const QRectF rect = rectFromPoint(pos, me ? 0.7 : 0.25);
 
-    foreach (WallItem *item, m_walls) {
-        if (item->type() == 6
-            || (item->type() == -1 && m_doorAnimation->state() != QTimeLine::Running
-               && m_doorAnimation->direction() == QTimeLine::Backward))
-            continue;
-
-        const QPointF a = item->a();
-        const QPointF b = item->b();
+    // walls are 0.01 thick on either side of the cell boundary
+    const QRectF wallRect = rect.adjusted(-0.01, -0.01, 0.01, 0.01);
+    const bool doorsOpen = m_doorProgress == 0;
 
-        QRectF wallRect = QRectF(a, b).adjusted(-0.01, -0.01, 0.01, 0.01);
+    for (int y = qFloor(wallRect.top()); y <= qFloor(wallRect.bottom()); ++y) {
+        for (int x = qFloor(wallRect.left()); x <= qFloor(wallRect.right()); ++x) {
+            if (!m_map.contains(x, y))
+                return true;
 
-        if (wallRect.intersects(rect))
-            return true;
+            const int collision = m_collisionMap.at(y * m_width + x);
+            if (collision == Solid || (collision == DoorCell && !doorsOpen))
+                return true;
+        }
     }
 
-    foreach (Entity *entity, m_entities) {
-        if (entity == me)
-            continue;
-        QRectF entityRect = rectFromPoint(entity->pos(), 0.8);
+    // entities are 0.8 wide, so only those centered within 0.4 of the
+    // rect can overlap it
+    const QRectF entityRange = rect.adjusted(-0.4, -0.4, 0.4, 0.4);
+    for (int y = qFloor(entityRange.top()); y <= qFloor(entityRange.bottom()); ++y) {
+        for (int x = qFloor(entityRange.left()); x <= qFloor(entityRange.right()); ++x) {
+            if (!m_map.contains(x, y))
+                continue;
 
-        if (entityRect.intersects(rect))
-            return true;
+            QMultiHash<int, Entity *>::const_iterator it = m_entityCells.constFind(y * m_width + x);
+            for (; it != m_entityCells.constEnd() && it.key() == y * m_width + x; ++it) {
+                Entity *entity = it.value();
+                if (entity == me)
+                    continue;
+                QRectF entityRect = rectFromPoint(entity->pos(), 0.8);
+
+                if (entityRect.intersects(rect))
+                    return true;
+            }
+        }
     }
 
     if (me) {
-        QRectF cameraRect = rectFromPoint(m_camera.pos(), 0.4);
+        QRectF cameraRect = rectFromPoint(m_simulatedCamera.pos(), 0.4);
 
         if (cameraRect.intersects(rect))
             return true;
@@ -901,123 +1407,300 @@ bool MazeScene::tryMove(QPointF &pos, const QPointF &delta, Entity *entity) cons
     return pos != old;
 }
 
-struct Span
+void MazeScene::spanVisibility(const QTransform &cameraTransform, const QVector<ProjectedItem *> &items)
 {
-    ProjectedItem *item;
+    m_spanBuffer.clear();
 
-    // screen coordinates
-    float sx1;
-    float sx2;
+    // first add all opaque items
+    foreach (ProjectedItem *item, items) {
+        if (item->isOpaque()) {
+            item->setObscured(true);
+            m_spanBuffer.insert(item, cameraTransform, false);
+        }
+    }
 
-    float cy;
-};
+    // mark visible opaque items
+    for (int i = 0; i < m_spanBuffer.size(); ++i)
+        if (m_spanBuffer.at(i).item)
+            m_spanBuffer.at(i).item->setObscured(false);
 
-int split(QList<Span> &list, float x)
-{
-    for (int i = 0; i < list.size(); ++i) {
-        Span &span = list[i];
-        if (span.sx2 == x)
-            return i+1;
+    // now add all non-opaque items
+    foreach (ProjectedItem *item, items) {
+        if (!item->isOpaque())
+            item->setObscured(!m_spanBuffer.insert(item, cameraTransform, true));
+    }
 
-        if (span.sx1 <= x && span.sx2 > x) {
-            Span split = span;
-            span.sx2 = x;
-            split.sx1 = x;
-            list.insert(i+1, split);
-            return i+1;
-        }
+    foreach (ProjectedItem *item, items) {
+        if (!item->isObscured())
+            m_visibleItems << item;
     }
-    return -1;
 }
 
-bool insertSpan(QList<Span> &list, const Span &span, bool checkOnly)
+void MazeScene::markVisible(ProjectedItem *item)
 {
-    int left = split(list, span.sx1);
-    int right = split(list, span.sx2);
-
-    bool visible = false;
-    for (int i = left; i < right; ++i) {
-        Span &s = list[i];
-        if (s.cy > span.cy) {
-            visible = true;
-            if (!checkOnly) {
-                s.item = span.item;
-                s.cy = span.cy;
-            }
-        }
+    if (item->isObscured()) {
+        item->setObscured(false);
+        m_visibleItems << item;
     }
-    return visible;
 }
 
-bool insertProjectedItem(QList<Span> &list, ProjectedItem *item, const QTransform &cameraTransform, bool checkOnly)
+// finds the wall faces on the boundary between cell (x, y) and its
+// neighbour (nx, ny) across the given side, at most one for each cell
+int MazeScene::crossedFaces(int x, int y, int nx, int ny, int side, WallItem **faces) const
 {
-    QPointF ca = cameraTransform.map(item->a());
-    QPointF cb = cameraTransform.map(item->b());
+    const int from = m_map.type(x, y);
+    const int to = m_map.type(nx, ny);
 
-    if (ca.y() <= 0 && cb.y() <= 0)
-        return false;
+    int count = 0;
+    if (from < TileMap::Wall && to >= TileMap::Door)
+        faces[count++] = m_faces.at(faceIndex(x, y, side));
+    if (to < TileMap::Wall && from >= TileMap::Door)
+        faces[count++] = m_faces.at(faceIndex(nx, ny, TileMap::opposite(side)));
+    return count;
+}
 
-    const float clip = 0.0001;
-    if (ca.y() <= 0) {
-        float t = (clip - ca.y()) / (cb.y() - ca.y());
-        ca.setX(ca.x() + t * (cb.x() - ca.x()));
-        ca.setY(clip);
-    } else if(cb.y() <= 0) {
-        float t = (clip - ca.y()) / (cb.y() - ca.y());
-        cb.setX(ca.x() + t * (cb.x() - ca.x()));
-        cb.setY(clip);
-    }
+// walks the tile grid along the ray, marking every face it passes until
+// it hits an opaque one
+void MazeScene::castRay(const QPointF &origin, const QPointF &direction)
+{
+    GridRay ray(origin, direction);
+    while (m_map.contains(ray.x(), ray.y())) {
+        const int x = ray.x();
+        const int y = ray.y();
+        m_cellStamps[y * m_width + x] = m_visibilityFrame;
 
-    Span span;
-    span.item = item;
-    span.sx1 = ca.x() / ca.y();
-    span.sx2 = cb.x() / cb.y();
-    span.cy = (ca.y() + cb.y()) * 0.5f;
+        ray.next();
 
-    if (span.sx1 >= span.sx2)
-        qSwap(span.sx1, span.sx2);
+        WallItem *faces[2];
+        const int count = crossedFaces(x, y, ray.x(), ray.y(), ray.side(), faces);
 
-    return insertSpan(list, span, checkOnly);
+        bool stop = false;
+        for (int i = 0; i < count; ++i) {
+            markVisible(faces[i]);
+            stop = stop || faces[i]->isOpaque();
+        }
+
+        // a solid cell ends the ray even when it came from a see-through
+        // cell, where there is no face between them to stop it
+        const int type = m_map.type(ray.x(), ray.y());
+        if (stop || (type >= TileMap::Wall && type != 2))
+            return;
+    }
 }
 
-void MazeScene::updateTransforms()
+void MazeScene::raycastVisibility(const QTransform &cameraTransform)
+{
+    ++m_visibilityFrame;
+
+    // one ray per screen column, spread over the horizontal field of view
+    const QTransform inverse = cameraTransform.inverted();
+    const QPointF origin = m_camera.pos();
+    const qreal focalLength = fromProjection(m_camera.fov())(0, 0);
+    const qreal extent = 1.1 * m_screenExtent / qAbs(focalLength);
+
+    for (int i = 0; i < m_rayCount; ++i) {
+        const qreal sx = extent * (2 * (i + qreal(0.5)) / m_rayCount - 1);
+        castRay(origin, inverse.map(QPointF(sx, 1)) - origin);
+    }
+
+    // items that aren't part of the grid are visible if any ray
+    // reached the cell they are in
+    foreach (ProjectedItem *item, m_dynamicItems) {
+        const QPointF center = (item->a() + item->b()) / 2;
+        const int x = qFloor(center.x());
+        const int y = qFloor(center.y());
+
+        if (m_map.contains(x, y) && m_cellStamps.at(y * m_width + x) == m_visibilityFrame)
+            markVisible(item);
+    }
+}
+
+bool MazeScene::doorsClosed() const
+{
+    // all doors are animated together
+    return m_doors.isEmpty() || m_doors.first()->isOpaque();
+}
+
+QVector<WallItem *> MazeScene::wallsInCells(const QBitArray &cells) const
+{
+    // faces are stored with the open cell in front of them, so grow the
+    // cell set by one to take in the faces of visible walls
+    QBitArray grown = cells;
+    for (int cell = 0; cell < cells.size(); ++cell) {
+        if (!cells.testBit(cell))
+            continue;
+        const int x = cell % m_width;
+        const int y = cell / m_width;
+        if (x > 0)
+            grown.setBit(cell - 1);
+        if (x < m_width - 1)
+            grown.setBit(cell + 1);
+        if (y > 0)
+            grown.setBit(cell - m_width);
+        if (y < m_height - 1)
+            grown.setBit(cell + m_width);
+    }
+
+    QSet<WallItem *> walls;
+    for (int cell = 0; cell < grown.size(); ++cell) {
+        if (!grown.testBit(cell))
+            continue;
+        for (int side = 0; side < 4; ++side) {
+            if (WallItem *item = m_faces.at(cell * 4 + side))
+                walls << item;
+        }
+    }
+
+    return walls.toList().toVector();
+}
+
+MazeScene::VisibleSet MazeScene::computeVisibleSet(int cell) const
 {
-    Span span;
-    span.item = 0;
-    span.sx1 = -std::numeric_limits<float>::infinity();
-    span.sx2 =  std::numeric_limits<float>::infinity();
-    span.cy = std::numeric_limits<float>::infinity();
+    VisibleSet set;
+    set.built = true;
+
+    const int x = cell % m_width;
+    const int y = cell / m_width;
+    if (m_map.type(x, y) >= TileMap::Wall)
+        return set;
+
+    // a permissive field of view from the whole cell, so no camera
+    // position inside it can see a wall that is not in the set
+    const QBitArray cells = FieldOfView(m_sightBlocked, m_width, m_height).visibleFrom(x, y);
+    const QBitArray cellsWithDoorsOpen =
+        FieldOfView(m_sightBlockedWithDoorsOpen, m_width, m_height).visibleFrom(x, y);
+
+    set.walls = wallsInCells(cells);
 
-    QList<Span> visibleList;
-    visibleList << span;
+    QSet<WallItem *> behindDoors = wallsInCells(cellsWithDoorsOpen).toList().toSet();
+    foreach (WallItem *item, set.walls)
+        behindDoors.remove(item);
+    set.wallsBehindDoors = behindDoors.toList().toVector();
+
+    return set;
+}
+
+void MazeScene::buildVisibleSets()
+{
+    const int cellCount = m_width * m_height;
+    m_visibleSets.resize(cellCount);
+
+    // see-through walls never block the view, doors only when closed
+    m_sightBlocked = QBitArray(cellCount);
+    m_sightBlockedWithDoorsOpen = QBitArray(cellCount);
+    for (int y = 0; y < m_height; ++y) {
+        for (int x = 0; x < m_width; ++x) {
+            const int type = m_map.type(x, y);
+            if (type == TileMap::Door) {
+                m_sightBlocked.setBit(y * m_width + x);
+            } else if (type >= TileMap::Wall && type != 2) {
+                m_sightBlocked.setBit(y * m_width + x);
+                m_sightBlockedWithDoorsOpen.setBit(y * m_width + x);
+            }
+        }
+    }
+
+    QVector<int> cells(cellCount);
+    for (int i = 0; i < cellCount; ++i)
+        cells[i] = i;
+
+#ifndef QT_NO_CONCURRENT
+    // large maps would stall the load, so walls are culled by the other
+    // passes alone until their sets are ready
+    if (cellCount > 32 * 32) {
+        m_visibleSetWatcher = new QFutureWatcher<VisibleSet>(this);
+        connect(m_visibleSetWatcher, SIGNAL(finished()), this, SLOT(visibleSetsBuilt()));
+        m_visibleSetWatcher->setFuture(QtConcurrent::mapped(cells, VisibleSetBuilder(this)));
+        return;
+    }
+
+    m_visibleSets = QtConcurrent::blockingMapped<QVector<VisibleSet> >(cells, VisibleSetBuilder(this));
+#else
+    VisibleSetBuilder builder(this);
+    for (int i = 0; i < cellCount; ++i)
+        m_visibleSets[i] = builder(i);
+#endif
+}
+
+void MazeScene::visibleSetsBuilt()
+{
+#ifndef QT_NO_CONCURRENT
+    if (m_visibleSetWatcher->isCanceled())
+        return;
+
+    m_visibleSets = m_visibleSetWatcher->future().results().toVector();
+    m_visibleSetWatcher->deleteLater();
+    m_visibleSetWatcher = 0;
+    requestFrame();
+#endif
+}
+
+const QVector<ProjectedItem *> &MazeScene::potentiallyVisibleItems()
+{
+    const int x = qFloor(m_camera.pos().x());
+    const int y = qFloor(m_camera.pos().y());
+    if (!m_map.contains(x, y))
+        return m_projectedItems;
+
+    const VisibleSet &set = m_visibleSets.at(y * m_width + x);
+    if (!set.built)
+        return m_projectedItems;
+
+    m_candidateItems.resize(0);
+    foreach (WallItem *item, set.walls)
+        m_candidateItems << item;
+    if (!doorsClosed()) {
+        foreach (WallItem *item, set.wallsBehindDoors)
+            m_candidateItems << item;
+    }
+    m_candidateItems += m_dynamicItems;
+
+    return m_candidateItems;
+}
+
+void MazeScene::updateTransforms()
+{
+    ProfileScope scope(FrameProfiler::UpdateTransforms, !isEmbedded());
+    TraceScope trace("updateTransforms", "visibility");
 
     QTransform rotation;
     rotation *= QTransform().translate(-m_camera.pos().x(), -m_camera.pos().y());
     rotation *= rotatingTransform(m_camera.yaw());
 
-    // first add all opaque items
-    foreach (ProjectedItem *item, m_projectedItems) {
-        if (item->isOpaque()) {
-            item->setObscured(true);
-            insertProjectedItem(visibleList, item, rotation, false);
-        }
-    }
+    QVector<ProjectedItem *> previous;
+    qSwap(previous, m_visibleItems);
 
-    // mark visible opaque items
-    for (int i = 0; i < visibleList.size(); ++i)
-        if (visibleList.at(i).item)
-            visibleList.at(i).item->setObscured(false);
+    foreach (ProjectedItem *item, previous)
+        item->setObscured(true);
 
-    // now add all non-opaque items
-    foreach (ProjectedItem *item, m_projectedItems) {
-        if (!item->isOpaque())
-            item->setObscured(!insertProjectedItem(visibleList, item, rotation, true));
+    {
+        TraceScope trace("visibility", "visibility");
+        if (m_visibilityMode == RaycastVisibility)
+            raycastVisibility(rotation);
+        else
+            spanVisibility(rotation, potentiallyVisibleItems());
+    }
+
+    // only items that were or have become visible need new transforms
+    foreach (ProjectedItem *item, previous) {
+        if (item->isObscured())
+            item->updateTransform(m_camera);
     }
 
-    foreach (ProjectedItem *item, m_projectedItems)
+    foreach (ProjectedItem *item, m_visibleItems)
         item->updateTransform(m_camera);
 
-    foreach (WallItem *item, m_walls) {
+    updateWallBatches();
+
+    if (FrameProfiler::isEnabled() && !isEmbedded()) {
+        FrameProfiler *profiler = FrameProfiler::instance();
+        profiler->setCounter(FrameProfiler::VisibleItems, m_visibleItems.size());
+        profiler->setCounter(FrameProfiler::ObscuredItems, m_projectedItems.size() - m_visibleItems.size());
+        profiler->setCounter(FrameProfiler::Spans,
+                             m_visibilityMode == SpanVisibility ? m_spanBuffer.size() : 0);
+    }
+
+    foreach (WallItem *item, m_widgetWalls) {
         if (item->isVisible() && !item->isObscured()) {
             // embed recursive scene
             if (QGraphicsProxyWidget *child = item->childItem()) {
@@ -1032,7 +1715,7 @@ void MazeScene::updateTransforms()
                     QVector<Light> lights;
                     lights << Light(QPointF(2.5, 2.5), 1)
                            << Light(QPointF(1.5, 1.5), 0.4);
-                    MazeScene *embeddedScene = new MazeScene(lights, map, 5, 5);
+                    MazeScene *embeddedScene = new MazeScene(lights, TileMap(map, 5, 5));
                     view->setScene(embeddedScene);
                     view->setRenderHints(QPainter::SmoothPixmapTransform | QPainter::Antialiasing);
                 }
@@ -1050,15 +1733,197 @@ void MazeScene::updateTransforms()
     update();
 }
 
-void MazeScene::move()
+static bool furtherAway(const WallPiece &a, const WallPiece &b)
+{
+    return a.depth < b.depth;
+}
+
+// the index of the depth range between the items that depth falls in
+static int depthSegment(const QVector<qreal> &itemDepths, qreal depth)
+{
+    return qLowerBound(itemDepths.begin(), itemDepths.end(), depth) - itemDepths.begin();
+}
+
+static WallPiece wallPiece(ProjectedItem *wall, int first, int count, const QPointF &camera)
+{
+    const QPointF center = wall->b() + (wall->a() - wall->b()) * ((first + count * 0.5) / wall->cellCount());
+    const WallPiece piece = { wall, first, count, -QLineF(camera, center).length() };
+    return piece;
+}
+
+// Hands the visible batched walls to the wall batches, split at the depth
+// of each visible item that's drawn on its own. A merged wall whose cells
+// fall on both sides of such an item is split between the batches, so
+// the item sorts as it would against separate walls.
+void MazeScene::updateWallBatches()
+{
+    QVector<ProjectedItem *> walls;
+    QVector<qreal> itemDepths;
+    foreach (ProjectedItem *item, m_visibleItems) {
+        if (!item->isBatched())
+            itemDepths << item->zValue();
+        else if (item->isProjected())
+            walls << item;
+    }
+
+    qSort(itemDepths);
+
+    const QPointF camera = m_camera.pos();
+    QVector<QVector<WallPiece> > segments(itemDepths.size() + 1);
+    foreach (ProjectedItem *wall, walls) {
+        const int cells = wall->cellCount();
+        if (cells == 1 || itemDepths.isEmpty()) {
+            const WallPiece piece = { wall, 0, cells, wall->depth() };
+            segments[depthSegment(itemDepths, piece.depth)] << piece;
+            continue;
+        }
+
+        int first = 0;
+        int segment = depthSegment(itemDepths, wallPiece(wall, 0, 1, camera).depth);
+        for (int i = 1; i <= cells; ++i) {
+            const int next = i < cells ? depthSegment(itemDepths, wallPiece(wall, i, 1, camera).depth) : -1;
+            if (next != segment) {
+                segments[segment] << wallPiece(wall, first, i - first, camera);
+                first = i;
+                segment = next;
+            }
+        }
+    }
+
+    while (m_wallBatches.size() < segments.size()) {
+        WallBatchItem *batch = new WallBatchItem(this);
+        addItem(batch);
+        m_wallBatches << batch;
+    }
+
+    for (int i = 0; i < m_wallBatches.size(); ++i) {
+        WallBatchItem *batch = m_wallBatches.at(i);
+        if (i < segments.size() && !segments.at(i).isEmpty()) {
+            QVector<WallPiece> &pieces = segments[i];
+            qSort(pieces.begin(), pieces.end(), furtherAway);
+            batch->setZValue(pieces.last().depth);
+            batch->setWalls(pieces);
+        } else {
+            batch->setWalls(QVector<WallPiece>());
+        }
+    }
+}
+
+bool MazeScene::advanceFrame()
 {
-    QSet<Entity *> movedEntities;
-    long elapsed = m_time.elapsed();
-    bool walked = false;
+    TraceScope trace("frame", "frame");
 
-    const int stepSize = 5;
+    const long time = m_time.elapsed();
+
+    bool cameraMoved = false;
+    bool changed = false;
+    if (m_simulation) {
+        if (const FrameSnapshot *snapshot = m_simulation->latestSnapshot())
+            cameraMoved = applySnapshot(*snapshot, time, &changed);
+    } else {
+        FrameSnapshot snapshot;
+        stepSimulation(time, &snapshot);
+        cameraMoved = applySnapshot(snapshot, time, &changed);
+    }
+
+    if (cameraMoved)
+        updateTransforms();
+    else if (changed)
+        update();
+
+    if (m_profilerItem->isVisible())
+        m_profilerItem->update();
+
+    // the torch flickers as long as it is on
+    return changed || m_torchLight >= 0;
+}
+
+void MazeScene::framePresented()
+{
+    m_frameDriver->framePresented();
+}
+
+// Restarts frames after they stopped because nothing changed, to be
+// called when input or anything else may set the scene in motion.
+void MazeScene::requestFrame()
+{
+    if (m_simulation)
+        m_simulation->wake();
+    else if (!m_frameDriver->isActive())
+        skipSimulation(m_time.elapsed());
+
+    m_frameDriver->requestFrame();
+}
+
+// moves the simulation time up without stepping, after it was idle
+void MazeScene::skipSimulation(long time)
+{
+    QMutexLocker locker(&m_simulationLock);
+    m_simulationTime = qMax(m_simulationTime, time - time % SimulationStep);
+}
+
+bool MazeScene::simulate(long elapsed)
+{
+    FrameSnapshot snapshot;
+    stepSimulation(elapsed, &snapshot);
+    return applySnapshot(snapshot, elapsed);
+}
+
+void MazeScene::setThreadedSimulation(bool enabled)
+{
+    if (enabled == (m_simulation != 0))
+        return;
+
+    if (enabled) {
+        m_simulation = new Simulation(this);
+        m_simulation->start();
+    } else {
+        delete m_simulation;
+        m_simulation = 0;
+    }
+}
+
+void MazeScene::setCamera(const Camera &camera)
+{
+    QMutexLocker locker(&m_simulationLock);
+    m_camera = camera;
+    m_simulatedCamera = camera;
+    m_previousCamera = camera;
+}
+
+// sets input the simulation may be reading on its own thread
+void MazeScene::setSimulationInput(qreal *input, qreal value)
+{
+    QMutexLocker locker(&m_simulationLock);
+    *input = value;
+}
+
+void MazeScene::setAutoWalking(bool walking)
+{
+    {
+        QMutexLocker locker(&m_simulationLock);
+        m_autoWalking = walking;
+    }
+    requestFrame();
+}
+
+// Runs the simulation steps up to the given time and writes the resulting
+// state to the snapshot. Only touches the simulation state, so it can run
+// on the simulation thread. Returns false if nothing changed.
+bool MazeScene::stepSimulation(long elapsed, FrameSnapshot *snapshot)
+{
+    TraceScope trace("simulate", "simulation");
+    QMutexLocker locker(&m_simulationLock);
+
+    const int stepSize = SimulationStep;
     int steps = (elapsed - m_simulationTime) / stepSize;
 
+    if (steps > MaxCatchUpSteps) {
+        TraceScope dropped("dropSteps", "simulation", QString::number(steps - MaxCatchUpSteps));
+        m_simulationTime += (steps - MaxCatchUpSteps) * stepSize;
+        steps = MaxCatchUpSteps;
+    }
+
     if (steps) {
         m_deltaYaw /= steps;
         m_deltaPitch /= steps;
@@ -1068,75 +1933,193 @@ void MazeScene::move()
     }
 
     qreal walkingVelocity = m_walkingVelocity;
-    if (m_walkingItem->walking())
+    if (m_autoWalking)
         walkingVelocity = 0.005;
 
+    const qreal doorDuration = 1000;
+
     for (int i = 0; i < steps; ++i) {
-        m_camera.setYaw(m_camera.yaw() + m_deltaYaw);
-        m_camera.setPitch(m_camera.pitch() + m_deltaPitch);
+        TraceScope step("step", "simulation");
+
+        if (i == steps - 1) {
+            m_previousCamera = m_simulatedCamera;
+            foreach (Entity *entity, m_entities)
+                entity->savePose();
+        }
+
+        m_simulatedCamera.setYaw(m_simulatedCamera.yaw() + m_deltaYaw);
+        m_simulatedCamera.setPitch(m_simulatedCamera.pitch() + m_deltaPitch);
 
         bool walking = false;
         if (walkingVelocity != 0) {
-            QPointF walkingDelta = QLineF::fromPolar(walkingVelocity, m_camera.yaw() - 90).p2();
-            QPointF pos = m_camera.pos();
+            QPointF walkingDelta = QLineF::fromPolar(walkingVelocity, m_simulatedCamera.yaw() - 90).p2();
+            QPointF pos = m_simulatedCamera.pos();
             if (tryMove(pos, walkingDelta)) {
                 walking = true;
-                m_camera.setPos(pos);
+                m_simulatedCamera.setPos(pos);
             }
         }
 
         if (m_strafingVelocity != 0) {
-            QPointF walkingDelta = QLineF::fromPolar(m_strafingVelocity, m_camera.yaw()).p2();
-            QPointF pos = m_camera.pos();
+            QPointF walkingDelta = QLineF::fromPolar(m_strafingVelocity, m_simulatedCamera.yaw()).p2();
+            QPointF pos = m_simulatedCamera.pos();
             if (tryMove(pos, walkingDelta)) {
                 walking = true;
-                m_camera.setPos(pos);
+                m_simulatedCamera.setPos(pos);
             }
         }
 
-        walked = walked || walking;
-
         if (walking)
             m_walkTime += stepSize;
         m_simulationTime += stepSize;
 
+        m_doorProgress = qBound(qreal(0), m_doorProgress + m_doorDirection * stepSize / doorDuration, qreal(1));
+
         foreach (Entity *entity, m_entities) {
+            const QPointF oldPos = entity->pos();
             if (entity->move(this))
-                movedEntities.insert(entity);
+                updateEntityCell(entity, oldPos);
         }
     }
 
-    m_camera.setTime(m_walkTime * 0.001);
+    m_simulatedCamera.setTime(m_walkTime * 0.001);
 
-    if (walked || m_deltaYaw != 0 || m_deltaPitch != 0) {
-        updateTransforms();
-    } else {
-        foreach (Entity *entity, movedEntities)
-            entity->updateTransform(m_camera);
+    // advance the sprite animation of all entities in one go
+    const int animationInterval = 300;
+    const int frames = (elapsed - m_animationTime) / animationInterval;
+    if (frames > 0) {
+        m_animationTime += frames * animationInterval;
+        foreach (Entity *entity, m_entities)
+            entity->advanceAnimation(frames);
     }
 
     if (steps) {
         m_deltaYaw = 0;
         m_deltaPitch = 0;
     }
+
+    bool still = m_previousCamera.pos() == m_simulatedCamera.pos()
+                 && m_previousCamera.yaw() == m_simulatedCamera.yaw()
+                 && m_previousCamera.pitch() == m_simulatedCamera.pitch()
+                 && m_doorProgress == (m_doorDirection > 0 ? 1 : 0);
+    for (int i = 0; still && i < m_entities.size(); ++i) {
+        const EntityPose previous = m_entities.at(i)->previousPose();
+        const EntityPose pose = m_entities.at(i)->pose();
+        still = previous.pos == pose.pos && previous.angle == pose.angle;
+    }
+    snapshot->still = still;
+
+    snapshot->time = m_simulationTime;
+    snapshot->camera = m_simulatedCamera;
+    snapshot->previousCamera = m_previousCamera;
+    snapshot->entities.resize(m_entities.size());
+    snapshot->previousEntities.resize(m_entities.size());
+    for (int i = 0; i < m_entities.size(); ++i) {
+        snapshot->entities[i] = m_entities.at(i)->pose();
+        snapshot->previousEntities[i] = m_entities.at(i)->previousPose();
+    }
+    snapshot->doorValue = QEasingCurve(QEasingCurve::InOutSine).valueForProgress(m_doorProgress);
+
+    return steps > 0 || frames > 0;
+}
+
+static inline qreal interpolate(qreal from, qreal to, qreal t)
+{
+    return from + (to - from) * t;
+}
+
+static inline QPointF interpolate(const QPointF &from, const QPointF &to, qreal t)
+{
+    return from + (to - from) * t;
+}
+
+// Brings the camera, doors and entity items to the snapshot's state at
+// the given time. Drawing runs a step behind the simulation, so the poses
+// are interpolated between the snapshot's last two steps. Returns true if
+// the camera moved, in which case updateTransforms() needs to be called.
+// Changed is set if anything moved or may still move.
+bool MazeScene::applySnapshot(const FrameSnapshot &snapshot, long time, bool *changed)
+{
+    ProfileScope scope(FrameProfiler::Move, !isEmbedded());
+
+    const qreal t = qBound(qreal(0), qreal(time - snapshot.time) / SimulationStep, qreal(1));
+
+    const Camera &from = snapshot.previousCamera;
+    Camera camera = snapshot.camera;
+    camera.setPos(interpolate(from.pos(), camera.pos(), t));
+    camera.setYaw(interpolate(from.yaw(), camera.yaw(), t));
+    camera.setPitch(interpolate(from.pitch(), camera.pitch(), t));
+    camera.setTime(interpolate(from.time(), camera.time(), t));
+
+    const bool cameraMoved = camera.pos() != m_camera.pos()
+                             || camera.yaw() != m_camera.yaw()
+                             || camera.pitch() != m_camera.pitch();
+    m_camera = camera;
+
+    const bool doorsMoved = snapshot.doorValue != m_doorValue;
+    if (doorsMoved) {
+        m_doorValue = snapshot.doorValue;
+        moveDoors(m_doorValue);
+    }
+
+    QVector<Entity *> movedEntities;
+    const int entityCount = qMin(m_entities.size(), snapshot.entities.size());
+    for (int i = 0; i < entityCount; ++i) {
+        const EntityPose &previous = snapshot.previousEntities.at(i);
+        EntityPose pose = snapshot.entities.at(i);
+        pose.pos = interpolate(previous.pos, pose.pos, t);
+        pose.angle = interpolate(previous.angle, pose.angle, t);
+
+        Entity *entity = m_entities.at(i);
+        if (entity->setPose(pose))
+            movedEntities << entity;
+    }
+
+    if (FrameProfiler::isEnabled() && !isEmbedded())
+        FrameProfiler::instance()->setCounter(FrameProfiler::MovedEntities, movedEntities.size());
+
+    // the torch follows the player and flickers a little
+    if (m_torchLight >= 0) {
+        const long elapsed = time;
+        const qreal flicker = 0.05 * qSin(elapsed * 0.013) + 0.03 * qSin(elapsed * 0.029);
+        setDynamicLight(m_torchLight, Light(m_camera.pos(), 0.4 + flicker, 3));
+    }
+    updateDynamicLighting();
+
+    if (!cameraMoved && !movedEntities.isEmpty()) {
+        foreach (Entity *entity, movedEntities)
+            entity->updateTransform(m_camera);
+
+        // the entities' depths changed relative to the walls
+        updateWallBatches();
+    }
+
+    if (changed)
+        *changed = cameraMoved || doorsMoved || !movedEntities.isEmpty() || !snapshot.still;
+    return cameraMoved;
 }
 
 void MazeScene::toggleDoors()
 {
     setFocusItem(0);
 
-    if (m_doorAnimation->state() == QTimeLine::Running)
+    QMutexLocker locker(&m_simulationLock);
+
+    // doors that are still moving finish first
+    if (m_doorProgress != (m_doorDirection > 0 ? 1 : 0))
         return;
 
     foreach (QPushButton *button, m_buttons) {
-        if (m_doorAnimation->direction() == QTimeLine::Forward)
+        if (m_doorDirection > 0)
             button->setText("Close Sesame!");
         else
             button->setText("Open Sesame!");
     }
 
-    m_doorAnimation->toggleDirection();
-    m_doorAnimation->start();
+    m_doorDirection = -m_doorDirection;
+    locker.unlock();
+
+    requestFrame();
 }
 
 void MazeScene::moveDoors(qreal value)
@@ -1151,8 +2134,14 @@ void MazeScene::moveDoors(qreal value)
             item->setOpaque(shouldBeOpaque);
         }
     }
-    if (opaqueStatusChanged)
+    if (opaqueStatusChanged) {
+        // open doors let the static lights through
+        if (m_lightOcclusion)
+            relightDoors();
         updateTransforms();
+    } else {
+        update();
+    }
 }
 
 void MazeScene::toggleRenderer()
@@ -1162,10 +2151,13 @@ void MazeScene::toggleRenderer()
         return;
     QGraphicsView *view = views().at(0);
     if (view) {
+        // swap in sync with the display, which paces the frame driver
+        QGLFormat format(QGL::SampleBuffers);
+        format.setSwapInterval(1);
         view->setViewport(
                 view->viewport()->inherits("QGLWidget")
                 ? new QWidget
-                : new QGLWidget(QGLFormat(QGL::SampleBuffers)));
+                : new QGLWidget(format));
 
         updateRenderer();
     }
@@ -1183,6 +2175,367 @@ void MazeScene::updateRenderer()
             view->setRenderHints(QPainter::Antialiasing);
     }
 
-    foreach (WallItem *item, m_walls)
-        item->updateLighting(m_lights, item->type() == 2);
+    bool synced = false;
+#ifndef QT_NO_OPENGL
+    if (view) {
+        if (QGLWidget *widget = qobject_cast<QGLWidget *>(view->viewport()))
+            synced = widget->format().swapInterval() > 0;
+    }
+#endif
+    m_frameDriver->setSyncedToDisplay(synced);
+}
+
+void MazeScene::setLightOcclusion(bool enabled)
+{
+    if (enabled == m_lightOcclusion)
+        return;
+
+    m_lightOcclusion = enabled;
+    bakeLighting();
+}
+
+// true if a wall tile lies between the two points, used for the dynamic
+// lights which move too often to keep a visibility polygon for
+bool MazeScene::isOccluded(const QPointF &from, const QPointF &to) const
+{
+    GridRay ray(from, to - from);
+    forever {
+        ray.next();
+        if (ray.distance() >= 1)
+            return false;
+        if (m_map.type(ray.x(), ray.y()) >= TileMap::Wall)
+            return true;
+    }
+}
+
+// Sum of the static lights at pos. Front is a point next to pos on the
+// open side, which is what the lights need to see.
+qreal MazeScene::staticLightAt(const QPointF &pos, const QPointF &front) const
+{
+    qreal l = 0;
+    for (int i = 0; i < m_lights.size(); ++i) {
+        if (!m_lightOcclusion || m_lightVisibility.at(i).contains(front))
+            l += m_lights.at(i).intensityAt(pos);
+    }
+    return l;
+}
+
+qreal MazeScene::dynamicLightAt(const QPointF &pos, const QPointF &front) const
+{
+    qreal l = 0;
+    foreach (int index, m_lightGrid.lightsAt(pos)) {
+        const Light &light = m_dynamicLights.at(index);
+        if (!m_lightOcclusion || !isOccluded(light.pos(), front))
+            l += light.intensityAt(pos);
+    }
+    return l;
+}
+
+// Walls meeting at a cell corner can face any of the four cells around
+// it, so the corner is lit as seen from just inside each open one. Returns
+// false if the cell, counted row by row from the top left, is a wall.
+bool MazeScene::cornerFront(int x, int y, int cell, QPointF *front) const
+{
+    const int cx = x - 1 + (cell & 1);
+    const int cy = y - 1 + (cell >> 1);
+    if (!m_map.contains(cx, cy) || m_map.type(cx, cy) >= TileMap::Wall)
+        return false;
+
+    *front = QPointF(x + (cx < x ? -0.01 : 0.01), y + (cy < y ? -0.01 : 0.01));
+    return true;
+}
+
+static inline int shadowFromLight(qreal l)
+{
+    const qreal constantIntensity = 80;
+    return qMax(0, 255 - int(constantIntensity + l));
+}
+
+// Sample positions along a wall, from b to a, and a small offset
+// towards the open cell it faces.
+QVector<QPointF> MazeScene::wallSamples(const WallItem *wall, QPointF *offset) const
+{
+    // occluded shadows change faster, so sample them more densely
+    const int samplesPerUnit = m_lightOcclusion ? 4 : 1;
+
+    const QLineF line(wall->b(), wall->a());
+    const QPointF direction = (line.p2() - line.p1()) / line.length();
+
+    QPointF normal(-direction.y(), direction.x());
+    const QPointF probe = line.pointAt(0.5) + normal * 0.25;
+    if (m_map.type(qFloor(probe.x()), qFloor(probe.y())) >= TileMap::Wall)
+        normal = -normal;
+    *offset = normal * 0.01;
+
+    const int segments = qMax(1, qRound(line.length())) * samplesPerUnit;
+    QVector<QPointF> samples(segments + 1);
+    for (int i = 0; i <= segments; ++i)
+        samples[i] = line.pointAt(qreal(i) / segments);
+    return samples;
+}
+
+void MazeScene::buildWallCells()
+{
+    m_cellWalls.clear();
+    m_cellWalls.resize(m_width * m_height);
+
+    // walls lie on cell edges, list them in the cells on both sides
+    for (int i = 0; i < m_walls.size(); ++i) {
+        const WallItem *wall = m_walls.at(i);
+        const QRectF bounds = QRectF(wall->a(), wall->b()).normalized().adjusted(-0.01, -0.01, 0.01, 0.01);
+        const QRect cells = QRect(QPoint(qFloor(bounds.left()), qFloor(bounds.top())),
+                                  QPoint(qFloor(bounds.right()), qFloor(bounds.bottom())))
+                            & QRect(0, 0, m_width, m_height);
+
+        for (int y = cells.top(); y <= cells.bottom(); ++y) {
+            for (int x = cells.left(); x <= cells.right(); ++x)
+                m_cellWalls[y * m_width + x] << i;
+        }
+    }
+
+    // wall ends lie on the grid corners
+    QSet<int> corners;
+    m_wallCorners.clear();
+    foreach (const WallItem *wall, m_walls) {
+        const QPointF ends[] = { wall->a(), wall->b() };
+        for (int i = 0; i < 2; ++i) {
+            const int key = qRound(ends[i].y()) * (m_width + 1) + qRound(ends[i].x());
+            if (!corners.contains(key)) {
+                corners.insert(key);
+                m_wallCorners << QPointF(qRound(ends[i].x()), qRound(ends[i].y()));
+            }
+        }
+    }
+}
+
+void MazeScene::buildLightVisibility()
+{
+    TraceScope trace("buildLightVisibility", "lighting");
+
+#ifndef QT_NO_CONCURRENT
+    m_lightVisibility = QtConcurrent::blockingMapped<QVector<VisibilityPolygon> >(m_lights, LightVisibilityBuilder(this));
+#else
+    LightVisibilityBuilder builder(this);
+    m_lightVisibility.resize(m_lights.size());
+    for (int i = 0; i < m_lights.size(); ++i)
+        m_lightVisibility[i] = builder(m_lights.at(i));
+#endif
+}
+
+void MazeScene::bakeLighting()
+{
+    TraceScope trace("bakeLighting", "lighting");
+
+    if (m_lightOcclusion)
+        buildLightVisibility();
+
+    m_staticWallLight.resize(m_walls.size());
+    m_staticCellLight.fill(0, m_width * m_height);
+    m_cellShadows = QByteArray(m_width * m_height, 0);
+#ifdef USE_GL_RENDERER
+    m_staticCornerLight.fill(-1, (m_width + 1) * (m_height + 1) * 4);
+    m_cornerShadows = QByteArray((m_width + 1) * (m_height + 1), 0);
+#endif
+
+    bakeStaticLight(QRect(0, 0, m_width, m_height));
+}
+
+// Bakes the static light of the walls, cells and corners in the given
+// cells, and relights them with the dynamic lights on top.
+void MazeScene::bakeStaticLight(const QRect &cells)
+{
+    QSet<int> walls;
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            foreach (int wall, m_cellWalls.at(y * m_width + x))
+                walls.insert(wall);
+        }
+    }
+
+    foreach (int index, walls) {
+        const WallItem *wall = m_walls.at(index);
+        if (wall->type() == 2)
+            continue;
+
+        QPointF offset;
+        const QVector<QPointF> samples = wallSamples(wall, &offset);
+
+        QVector<qreal> &light = m_staticWallLight[index];
+        light.resize(samples.size());
+        for (int j = 0; j < samples.size(); ++j)
+            light[j] = staticLightAt(samples.at(j), samples.at(j) + offset);
+    }
+
+    // one value per cell for the floor and ceiling, taken at its center
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            if (m_map.type(x, y) >= TileMap::Wall)
+                continue;
+            const QPointF center(x + 0.5, y + 0.5);
+            m_staticCellLight[y * m_width + x] = staticLightAt(center, center);
+        }
+    }
+
+#ifdef USE_GL_RENDERER
+    // walls lie on cell edges, so the corners match the wall samples above
+    for (int y = cells.top(); y <= cells.bottom() + 1; ++y) {
+        for (int x = cells.left(); x <= cells.right() + 1; ++x) {
+            const QPointF corner(x, y);
+            for (int i = 0; i < 4; ++i) {
+                QPointF front;
+                if (cornerFront(x, y, i, &front))
+                    m_staticCornerLight[(y * (m_width + 1) + x) * 4 + i] = staticLightAt(corner, front);
+            }
+        }
+    }
+#endif
+
+    m_dirtyLightCells |= cells;
+    updateDynamicLighting();
+}
+
+// Opening or closing the doors changes what the static lights can see.
+// Only the lights reaching a door cell are rebuilt, and only their reach
+// is baked again.
+void MazeScene::relightDoors()
+{
+    TraceScope trace("relightDoors", "lighting");
+
+    QVector<QPoint> doorCells;
+    for (int y = 0; y < m_height; ++y) {
+        for (int x = 0; x < m_width; ++x) {
+            if (m_map.type(x, y) == TileMap::Door)
+                doorCells << QPoint(x, y);
+        }
+    }
+
+    const LightVisibilityBuilder builder(this);
+    QRect dirty;
+    for (int i = 0; i < m_lights.size(); ++i) {
+        const Light &light = m_lights.at(i);
+        const QRect reach = m_lightGrid.cellsInReach(light.pos(), light.reach());
+
+        bool reachesDoor = false;
+        foreach (const QPoint &cell, doorCells) {
+            if (reach.contains(cell)) {
+                reachesDoor = true;
+                break;
+            }
+        }
+        if (!reachesDoor)
+            continue;
+
+        m_lightVisibility[i] = builder(light);
+        dirty |= reach;
+    }
+
+    if (!dirty.isEmpty())
+        bakeStaticLight(dirty);
+}
+
+int MazeScene::addDynamicLight(const Light &light)
+{
+    int id;
+    if (m_freeDynamicLights.isEmpty()) {
+        id = m_dynamicLights.size();
+        m_dynamicLights << Light();
+    } else {
+        id = m_freeDynamicLights.takeLast();
+    }
+
+    setDynamicLight(id, light);
+    return id;
+}
+
+void MazeScene::setDynamicLight(int id, const Light &light)
+{
+    const Light &old = m_dynamicLights.at(id);
+    if (old.intensity() > 0) {
+        m_lightGrid.remove(id, old.pos(), old.reach());
+        m_dirtyLightCells |= m_lightGrid.cellsInReach(old.pos(), old.reach());
+    }
+
+    m_dynamicLights[id] = light;
+
+    if (light.intensity() > 0) {
+        m_lightGrid.insert(id, light.pos(), light.reach());
+        m_dirtyLightCells |= m_lightGrid.cellsInReach(light.pos(), light.reach());
+    }
+
+    m_frameDriver->requestFrame();
+}
+
+void MazeScene::removeDynamicLight(int id)
+{
+    setDynamicLight(id, Light());
+    m_freeDynamicLights << id;
+}
+
+// relights the walls and cells within reach of the lights that changed
+void MazeScene::updateDynamicLighting()
+{
+    if (m_dirtyLightCells.isEmpty())
+        return;
+
+    TraceScope trace("relight", "lighting");
+
+    const QRect cells = m_dirtyLightCells;
+    m_dirtyLightCells = QRect();
+
+    QSet<int> walls;
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            const int cell = y * m_width + x;
+            foreach (int wall, m_cellWalls.at(cell))
+                walls.insert(wall);
+
+            if (m_map.type(x, y) >= TileMap::Wall)
+                continue;
+            const QPointF center(x + 0.5, y + 0.5);
+            const qreal l = m_staticCellLight.at(cell) + dynamicLightAt(center, center);
+            m_cellShadows[cell] = char(shadowFromLight(l));
+        }
+    }
+
+    foreach (int index, walls) {
+        WallItem *wall = m_walls.at(index);
+        if (wall->type() == 2)
+            continue;
+
+        QPointF offset;
+        const QVector<QPointF> samples = wallSamples(wall, &offset);
+        const QVector<qreal> &light = m_staticWallLight.at(index);
+
+        QVector<int> shadows(samples.size());
+        for (int i = 0; i < samples.size(); ++i) {
+            const qreal l = light.at(i) + dynamicLightAt(samples.at(i), samples.at(i) + offset);
+            shadows[i] = shadowFromLight(l);
+        }
+
+        wall->bakeLighting(shadows);
+    }
+
+    m_floorRenderer->setCellShadows(m_cellShadows);
+
+#ifdef USE_GL_RENDERER
+    // the corners of the dirty cells, taking the brightest side
+    const QRect corners = QRect(cells.topLeft(), cells.size() + QSize(1, 1));
+    for (int y = corners.top(); y <= corners.bottom(); ++y) {
+        for (int x = corners.left(); x <= corners.right(); ++x) {
+            const QPointF corner(x, y);
+            const int index = y * (m_width + 1) + x;
+            qreal l = 0;
+            for (int i = 0; i < 4; ++i) {
+                QPointF front;
+                if (cornerFront(x, y, i, &front))
+                    l = qMax(l, m_staticCornerLight.at(index * 4 + i) + dynamicLightAt(corner, front));
+            }
+            m_cornerShadows[index] = char(shadowFromLight(l));
+        }
+    }
+    m_glRenderer->setCornerShadows(m_cornerShadows, corners);
+#endif
+
+    // batched walls aren't scene items and can't schedule their own repaint
+    update();
 }
@@ -39,18 +39,36 @@ POSSIBILITY OF SUCH DAMAGE."
 #include <QGraphicsScene>
 #include <QGraphicsView>
 #include <QLineEdit>
+#include <QMutex>
 #include <QPlainTextEdit>
 #include <QPointF>
 #include <QPushButton>
 #include <QTime>
-#include <QTimeLine>
 
 #include <QMatrix4x4>
+#include <QSet>
+#include <QBitArray>
+#ifndef QT_NO_CONCURRENT
+#include <QFutureWatcher>
+#endif
+
+#include "lightgrid.h"
+#include "spanbuffer.h"
+#include "tilemap.h"
+#include "visibilitypolygon.h"
 
 class MazeScene;
+class MapFile;
 class MediaPlayer;
 class Entity;
 class WalkingItem;
+class Simulation;
+class FrameDriver;
+struct FrameSnapshot;
+class ProfilerItem;
+class GLRenderer;
+class ColumnRenderer;
+class FloorRenderer;
 
 class View : public QGraphicsView
 {
@@ -82,6 +100,7 @@ public:
     qreal pitch() const { return m_pitch; }
     qreal fov() const { return m_fov; }
     QPointF pos() const { return m_pos; }
+    qreal time() const { return m_time; }
 
     void setYaw(qreal yaw);
     void setPitch(qreal pitch);
@@ -110,23 +129,34 @@ private:
 class Light
 {
 public:
-    Light() {}
-    Light(const QPointF &pos, qreal intensity);
+    Light() : m_intensity(0), m_radius(0) {}
+    Light(const QPointF &pos, qreal intensity, qreal radius = 0);
 
     qreal intensityAt(const QPointF &pos) const;
 
+    // A light with a radius fades out smoothly towards it and doesn't
+    // reach any further, without one the falloff is unlimited.
+    qreal radius() const { return m_radius; }
+
+    // distance beyond which the light adds less than one shade step
+    qreal reach() const;
+
     QPointF pos() const { return m_pos; }
     qreal intensity() const { return m_intensity; }
 
+    void setPos(const QPointF &pos) { m_pos = pos; }
+    void setIntensity(qreal intensity) { m_intensity = intensity; }
+
 private:
     QPointF m_pos;
     qreal m_intensity;
+    qreal m_radius;
 };
 
 class ProjectedItem : public QGraphicsItem
 {
 public:
-    ProjectedItem(const QRectF &bounds, bool shadow = true, bool opaque = true);
+    ProjectedItem(const QRectF &bounds, bool opaque = true);
 
     QPointF a() const { return m_a; }
     QPointF b() const { return m_b; }
@@ -140,25 +170,73 @@ public:
 
     void setPosition(const QPointF &a, const QPointF &b);
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
+
+    // merged walls span several cells, counted from b() like the texture
+    int cellCount() const;
+    void paintCells(QPainter *painter, int first, int count);
     void setAnimationTime(qreal time);
     void setImage(const QImage &image);
-    void updateLighting(const QVector<Light> &lights, bool useConstantLight);
-
-    void setLightingEnabled(bool enabled);
+    const QImage &image() const { return m_image; }
+    QRectF targetRect() const { return m_targetRect; }
 
     void setObscured(bool obscured);
     bool isObscured() const;
 
+    // Batched items aren't added to the scene but painted by a
+    // WallBatchItem, updateTransform() then only stores the projection.
+    // The index is the item's position in the scene's list of batched items.
+    void setBatchIndex(int index);
+    int batchIndex() const { return m_batchIndex; }
+    bool isBatched() const { return m_batchIndex >= 0; }
+
+    bool isProjected() const { return m_projected; }
+    qreal depth() const { return m_depth; }
+    const QTransform &projection() const { return m_projection; }
+
 private:
     QPointF m_a;
     QPointF m_b;
     QRectF m_bounds;
     QRectF m_targetRect;
     QImage m_image;
-    QGraphicsRectItem *m_shadowItem;
 
     bool m_opaque;
     bool m_obscured;
+
+    int m_batchIndex;
+    bool m_projected;
+    qreal m_depth;
+    QTransform m_projection;
+};
+
+// The cells [first, first + count) of a batched wall, at the depth of
+// their center. Usually the whole wall, but long runs are split where an
+// item is drawn between their cells.
+struct WallPiece
+{
+    ProjectedItem *wall;
+    int first;
+    int count;
+    qreal depth;
+};
+
+// Paints a list of batched walls back to front in a single item. The
+// scene uses one for each depth range between the items that are still
+// drawn individually, so the walls stay correctly ordered around them.
+class WallBatchItem : public QGraphicsItem
+{
+public:
+    WallBatchItem(MazeScene *scene);
+
+    void setWalls(const QVector<WallPiece> &walls);
+
+    QRectF boundingRect() const;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
+
+private:
+    MazeScene *m_scene;
+    QVector<WallPiece> m_walls;
+    QRectF m_bounds;
 };
 
 class WallItem : public ProjectedItem
@@ -173,32 +251,107 @@ public:
 
     int type() const { return m_type; }
 
+    bool isBatchable() const { return !m_childItem && childItems().isEmpty(); }
+
+    // Replaces the image with the texture darkened by the given shadow
+    // alphas, sampled evenly from b to a and interpolated in between.
+    void bakeLighting(const QVector<int> &shadows);
+
     void childResized();
 
 private:
     QGraphicsProxyWidget *m_childItem;
     int m_type;
     qreal m_scale;
+    QImage m_texture;
 };
 
 class MazeScene : public QGraphicsScene
 {
     Q_OBJECT
 public:
-    MazeScene(const QVector<Light> &lights, const char *map, int width, int height);
+    enum VisibilityMode
+    {
+        SpanVisibility,
+        RaycastVisibility
+    };
+
+    // takes ownership of the map file, which provides the start position,
+    // entity spawns and widget placements
+    MazeScene(const QVector<Light> &lights, const TileMap &map, MapFile *file = 0);
+    ~MazeScene();
+
+    static MazeScene *load(const QString &fileName);
 
     void addProjectedItem(ProjectedItem *item);
     void addEntity(Entity *entity);
-    void addWall(const QPointF &a, const QPointF &b, int type);
+    WallItem *addWall(const QPointF &a, const QPointF &b, int type);
     void drawBackground(QPainter *painter, const QRectF &rect);
+    void drawForeground(QPainter *painter, const QRectF &rect);
 
     bool tryMove(QPointF &pos, const QPointF &delta, Entity *entity = 0) const;
 
     Camera camera() const { return m_camera; }
+    void setCamera(const Camera &camera);
+
+    const TileMap &map() const { return m_map; }
 
     void viewResized(QGraphicsView *view);
     void setAcceleratedViewport(bool accelerated);
 
+    void setVisibilityMode(VisibilityMode mode);
+    VisibilityMode visibilityMode() const { return m_visibilityMode; }
+
+    // Advances the simulation to the given time in milliseconds since the
+    // scene was created. Returns true if the camera moved, in which case
+    // updateTransforms() needs to be called.
+    bool simulate(long time);
+    void updateTransforms();
+
+    // Does the work for one frame, called by the frame driver: takes the
+    // simulation's state, updates visibility and schedules painting.
+    // Returns false if nothing changed, so frames can stop until the next
+    // requestFrame().
+    bool advanceFrame();
+    void framePresented();
+
+    // Runs the simulation on its own thread, advanceFrame() then only
+    // picks up its latest state. Don't call simulate() while it is enabled.
+    void setThreadedSimulation(bool enabled);
+    bool threadedSimulation() const { return m_simulation != 0; }
+
+    // walks forward without a key held down
+    void setAutoWalking(bool walking);
+
+    // Lights are static, so their shadows are baked into the wall images
+    // and floor cells when the scene is built. With occlusion, walls
+    // between a light and a point keep the light from reaching it, using
+    // a visibility polygon per static light that is rebuilt along with
+    // the baked lighting when the doors open or close.
+    void setLightOcclusion(bool enabled);
+    bool lightOcclusion() const { return m_lightOcclusion; }
+
+    // Dynamic lights add to the baked ones and can move or flicker. Only
+    // the walls and cells within reach of a changed light are relit, at
+    // the start of the next frame. Returns the id for the other calls.
+    int addDynamicLight(const Light &light);
+    void setDynamicLight(int id, const Light &light);
+    void removeDynamicLight(int id);
+
+#ifdef USE_GL_RENDERER
+    GLRenderer *glRenderer() const { return m_glRenderer; }
+#endif
+
+    // Renders walls, floor and ceiling with ColumnRenderer instead of
+    // projecting the items when the view doesn't paint with OpenGL.
+    void setSoftwareRendering(bool enabled);
+    bool softwareRendering() const { return m_softwareRendering; }
+    bool isSoftwareRendered(QPainter *painter) const;
+
+    // the wall faces crossed when stepping from cell x, y to cell nx, ny
+    // over the given side, returns how many were written to faces
+    int crossedFaces(int x, int y, int nx, int ny, int side, WallItem **faces) const;
+
 protected:
     void mouseMoveEvent(QGraphicsSceneMouseEvent *event);
     void keyPressEvent(QKeyEvent *event);
@@ -206,21 +359,115 @@ protected:
     bool eventFilter(QObject *target, QEvent *event);
 
     bool handleKey(int key, bool pressed);
+    bool isEmbedded() const;
+    void updateWallBatches();
 
 public slots:
-    void move();
+    void requestFrame();
     void toggleRenderer();
     void toggleDoors();
     void loadFinished();
 
 private slots:
-    void moveDoors(qreal value);
+    void visibleSetsBuilt();
 
 private:
+    friend class Simulation;
+
+    // Length of a simulation step in milliseconds, and the most steps
+    // run at once when catching up after a stall. Time beyond that is
+    // dropped, so the simulation slows down instead of falling behind.
+    enum { SimulationStep = 5, MaxCatchUpSteps = 40 };
+
+    long elapsed() const { return m_time.elapsed(); }
+    bool stepSimulation(long time, FrameSnapshot *snapshot);
+    bool applySnapshot(const FrameSnapshot &snapshot, long time, bool *changed = 0);
+    void skipSimulation(long time);
+    void setSimulationInput(qreal *input, qreal value);
+    void moveDoors(qreal value);
+
+    enum CollisionType
+    {
+        Free,
+        Solid,
+        DoorCell
+    };
+
+    void buildCollisionMap();
+    int cellKey(const QPointF &pos) const;
+    void updateEntityCell(Entity *entity, const QPointF &oldPos);
     bool blocked(const QPointF &pos, Entity *entity) const;
-    void updateTransforms();
     void updateRenderer();
 
+    void buildWallCells();
+    void bakeLighting();
+    void bakeStaticLight(const QRect &cells);
+    void relightDoors();
+    void updateDynamicLighting();
+    QVector<QPointF> wallSamples(const WallItem *wall, QPointF *offset) const;
+    qreal staticLightAt(const QPointF &pos, const QPointF &front) const;
+    qreal dynamicLightAt(const QPointF &pos, const QPointF &front) const;
+    bool cornerFront(int x, int y, int cell, QPointF *front) const;
+    void buildLightVisibility();
+    bool isOccluded(const QPointF &from, const QPointF &to) const;
+
+    int faceType(int x, int y, int side) const;
+    static bool isPlainWallType(int type);
+    void addWallRun(int x, int y, int side, int length, int type);
+
+    struct VisibleSet
+    {
+        VisibleSet() : built(false) {}
+
+        QVector<WallItem *> walls;
+        // walls that can only be seen through a door
+        QVector<WallItem *> wallsBehindDoors;
+        bool built;
+    };
+
+    struct VisibleSetBuilder
+    {
+        typedef VisibleSet result_type;
+
+        VisibleSetBuilder(const MazeScene *scene) : scene(scene) {}
+        VisibleSet operator()(int cell) const { return scene->computeVisibleSet(cell); }
+
+        const MazeScene *scene;
+    };
+
+    struct LightVisibilityBuilder
+    {
+        typedef VisibilityPolygon result_type;
+
+        LightVisibilityBuilder(const MazeScene *scene) : scene(scene) {}
+        VisibilityPolygon operator()(const Light &light) const
+        {
+            return VisibilityPolygon(light.pos(), scene->m_map, scene->m_wallCorners,
+                                     light.reach(), scene->doorsClosed());
+        }
+
+        const MazeScene *scene;
+    };
+
+    void spanVisibility(const QTransform &cameraTransform, const QVector<ProjectedItem *> &items);
+    void raycastVisibility(const QTransform &cameraTransform);
+    void castRay(const QPointF &origin, const QPointF &direction);
+    void markVisible(ProjectedItem *item);
+
+    void buildVisibleSets();
+    VisibleSet computeVisibleSet(int cell) const;
+    QVector<WallItem *> wallsInCells(const QBitArray &cells) const;
+    const QVector<ProjectedItem *> &potentiallyVisibleItems();
+    bool doorsClosed() const;
+
+    int faceIndex(int x, int y, int side) const
+    {
+        return (y * m_width + x) * 4 + side;
+    }
+
+    MapFile *m_mapFile;
+    TileMap m_map;
+
     QVector<WallItem *> m_walls;
     QVector<WallItem *> m_doors;
     QVector<QGraphicsItem *> m_floorTiles;
@@ -229,28 +476,110 @@ private:
     QVector<Light> m_lights;
     QVector<ProjectedItem *> m_projectedItems;
 
+    // wall faces indexed by open cell and side
+    QVector<WallItem *> m_faces;
+    QVector<WallItem *> m_widgetWalls;
+    // walls painted by m_wallBatches instead of being scene items
+    QVector<WallItem *> m_batchedWalls;
+    QVector<WallBatchItem *> m_wallBatches;
+#ifdef USE_GL_RENDERER
+    GLRenderer *m_glRenderer;
+#endif
+    ColumnRenderer *m_columnRenderer;
+    bool m_softwareRendering;
+    FloorRenderer *m_floorRenderer;
+    // projected items that are not part of the tile grid
+    QVector<ProjectedItem *> m_dynamicItems;
+    QVector<ProjectedItem *> m_visibleItems;
+    QVector<ProjectedItem *> m_candidateItems;
+
+    // potentially visible walls per cell, built at load for small maps
+    // and in the background for large ones
+    QVector<VisibleSet> m_visibleSets;
+#ifndef QT_NO_CONCURRENT
+    QFutureWatcher<VisibleSet> *m_visibleSetWatcher;
+#endif
+    // cells that block the view with the doors closed and open
+    QBitArray m_sightBlocked;
+    QBitArray m_sightBlockedWithDoorsOpen;
+
+    SpanBuffer m_spanBuffer;
+
+    // static collision per cell, and entities hashed by the cell they are in
+    QVector<quint8> m_collisionMap;
+    QMultiHash<int, Entity *> m_entityCells;
+
+    VisibilityMode m_visibilityMode;
+    QVector<int> m_cellStamps;
+    int m_visibilityFrame;
+    int m_rayCount;
+    qreal m_screenExtent;
+
     Camera m_camera;
+    qreal m_doorValue;
+
+    // Simulation state and the input driving it, guarded by
+    // m_simulationLock as the simulation may step on its own thread.
+    QMutex m_simulationLock;
+    Simulation *m_simulation;
+    FrameDriver *m_frameDriver;
+    Camera m_simulatedCamera;
+    // the camera before the last step, frames interpolate from it
+    Camera m_previousCamera;
 
     qreal m_walkingVelocity;
     qreal m_strafingVelocity;
     qreal m_turningSpeed;
     qreal m_pitchSpeed;
+    bool m_autoWalking;
 
     qreal m_deltaYaw;
     qreal m_deltaPitch;
 
+    // door animation progress, 1 when closed, and the way it is going
+    qreal m_doorProgress;
+    int m_doorDirection;
+
     QTime m_time;
-    QTimeLine *m_doorAnimation;
     long m_simulationTime;
     long m_walkTime;
+    long m_animationTime;
     int m_width;
     int m_height;
     MediaPlayer *m_player;
     QPointF m_playerPos;
 
     bool m_accelerated;
+    bool m_lightOcclusion;
+
+    // light from the static lights per wall sample and per cell, the
+    // dynamic lights are added on top when relighting
+    QVector<QVector<qreal> > m_staticWallLight;
+    QVector<qreal> m_staticCellLight;
+#ifdef USE_GL_RENDERER
+    // and per cell corner, where the GL renderer samples its shadows,
+    // seen from each of the four cells around it or -1 for wall cells
+    QVector<qreal> m_staticCornerLight;
+#endif
+    // what each static light can see, used for occlusion when baking
+    QVector<VisibilityPolygon> m_lightVisibility;
+    // the distinct wall end points, which the visibility rays aim at
+    QVector<QPointF> m_wallCorners;
+    QByteArray m_cellShadows;
+#ifdef USE_GL_RENDERER
+    QByteArray m_cornerShadows;
+#endif
+    // walls touching each cell, by index in m_walls
+    QVector<QVector<int> > m_cellWalls;
+
+    QVector<Light> m_dynamicLights;
+    QVector<int> m_freeDynamicLights;
+    LightGrid m_lightGrid;
+    QRect m_dirtyLightCells;
+    int m_torchLight;
 
     WalkingItem *m_walkingItem;
+    ProfilerItem *m_profilerItem;
 };
 
 #endif
@@ -39,6 +39,8 @@ POSSIBILITY OF SUCH DAMAGE."
 #include <QTextStream>
 #include <QVarLengthArray>
 
+#include <string.h>
+
 #ifndef QT_NO_OPENGL
 #if !defined QT_OPENGL_ES_2 && !defined Q_WS_MAC
 #include <GL/glew.h>
@@ -46,9 +48,27 @@ POSSIBILITY OF SUCH DAMAGE."
 #include <QtOpenGL>
 #endif
 
-Model::Model(const QString &filePath)
+Model::Model()
+#ifndef QT_NO_OPENGL
+    : m_bufferContext(0)
+    , m_triangleBuffer(QGLBuffer::IndexBuffer)
+    , m_edgeBuffer(QGLBuffer::IndexBuffer)
+#endif
+{
+}
+
+Model::Model(const QString &filePath, Parser parser, bool useCache)
     : m_fileName(QFileInfo(filePath).fileName())
+#ifndef QT_NO_OPENGL
+    , m_bufferContext(0)
+    , m_triangleBuffer(QGLBuffer::IndexBuffer)
+    , m_edgeBuffer(QGLBuffer::IndexBuffer)
+#endif
 {
+    const QFileInfo info(filePath);
+    if (useCache && loadCache(info))
+        return;
+
     QFile file(filePath);
     if (!file.open(QIODevice::ReadOnly))
         return;
@@ -56,6 +76,57 @@ Model::Model(const QString &filePath)
     QVector3D boundsMin( 1e9, 1e9, 1e9);
     QVector3D boundsMax(-1e9,-1e9,-1e9);
 
+    if (parser == TextStreamParser)
+        parseTextStream(file, boundsMin, boundsMax);
+    else
+        parseMapped(file, boundsMin, boundsMax);
+
+    const QVector3D bounds = boundsMax - boundsMin;
+    const qreal scale = 1 / qMax(bounds.x() / 1, qMax(bounds.y(), bounds.z() / 1));
+    for (int i = 0; i < m_points.size(); ++i)
+        m_points[i] = (m_points[i] - (boundsMin + bounds * 0.5)) * scale;
+
+    m_size = bounds * scale;
+
+    m_normals.resize(m_points.size());
+    for (int i = 0; i < m_pointIndices.size(); i += 3) {
+        const QVector3D a = m_points.at(m_pointIndices.at(i));
+        const QVector3D b = m_points.at(m_pointIndices.at(i+1));
+        const QVector3D c = m_points.at(m_pointIndices.at(i+2));
+
+        const QVector3D normal = QVector3D::crossProduct(b - a, c - a).normalized();
+
+        for (int j = 0; j < 3; ++j)
+            m_normals[m_pointIndices.at(i + j)] += normal;
+    }
+
+    for (int i = 0; i < m_normals.size(); ++i)
+        m_normals[i] = m_normals[i].normalized();
+
+    if (useCache && !m_points.isEmpty())
+        saveCache(info);
+}
+
+void Model::addFace(const int *p, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const int edgeA = p[i];
+        const int edgeB = p[(i + 1) % count];
+
+        if (edgeA < edgeB)
+            m_edgeIndices << edgeA << edgeB;
+    }
+
+    for (int i = 0; i < 3; ++i)
+        m_pointIndices << p[i];
+
+    if (count == 4)
+        for (int i = 0; i < 3; ++i)
+            m_pointIndices << p[(i + 2) % 4];
+}
+
+void Model::parseTextStream(QFile &file, QVector3D &boundsMin, QVector3D &boundsMax)
+{
     QTextStream in(&file);
     while (!in.atEnd()) {
         QString input = in.readLine();
@@ -84,44 +155,308 @@ Model::Model(const QString &filePath)
                     p.append(vertexIndex > 0 ? vertexIndex - 1 : m_points.size() + vertexIndex);
             }
 
-            for (int i = 0; i < p.size(); ++i) {
-                const int edgeA = p[i];
-                const int edgeB = p[(i + 1) % p.size()];
+            if (p.size() >= 3)
+                addFace(p.constData(), p.size());
+        }
+    }
+}
+
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static inline const char *skipSpace(const char *pos, const char *end)
+{
+    while (pos < end && isSpace(*pos))
+        ++pos;
+    return pos;
+}
+
+static inline const char *tokenEnd(const char *pos, const char *end)
+{
+    while (pos < end && !isSpace(*pos))
+        ++pos;
+    return pos;
+}
 
-                if (edgeA < edgeB)
-                    m_edgeIndices << edgeA << edgeB;
+// Parses a decimal number in [pos, end). Plain numbers with at most 15
+// significant digits and a small exponent are exact in double precision
+// and handled inline, everything else goes through QByteArray::toDouble().
+static double parseReal(const char *pos, const char *end)
+{
+    static const double powersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+        1e21, 1e22
+    };
+
+    const char *p = pos;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    quint64 mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool anyDigits = false;
+
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        anyDigits = true;
+        if (mantissa || *p != '0') {
+            mantissa = mantissa * 10 + (*p - '0');
+            ++digits;
+        }
+    }
+
+    if (p < end && *p == '.') {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+            anyDigits = true;
+            if (mantissa || *p != '0') {
+                mantissa = mantissa * 10 + (*p - '0');
+                ++digits;
             }
+            --exponent;
+        }
+    }
+
+    if (anyDigits && p < end && (*p == 'e' || *p == 'E')) {
+        const char *e = p + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+'))
+            negativeExponent = *e++ == '-';
 
-            for (int i = 0; i < 3; ++i)
-                m_pointIndices << p[i];
+        int value = 0;
+        const char *digitsStart = e;
+        for (; e < end && *e >= '0' && *e <= '9' && value < 10000; ++e)
+            value = value * 10 + (*e - '0');
 
-            if (p.size() == 4)
-                for (int i = 0; i < 3; ++i)
-                    m_pointIndices << p[(i + 2) % 4];
+        if (e > digitsStart) {
+            exponent += negativeExponent ? -value : value;
+            p = e;
         }
     }
 
-    const QVector3D bounds = boundsMax - boundsMin;
-    const qreal scale = 1 / qMax(bounds.x() / 1, qMax(bounds.y(), bounds.z() / 1));
-    for (int i = 0; i < m_points.size(); ++i)
-        m_points[i] = (m_points[i] - (boundsMin + bounds * 0.5)) * scale;
+    if (anyDigits && p == end && digits <= 15 && exponent >= -22 && exponent <= 22) {
+        double value = double(mantissa);
+        if (exponent < 0)
+            value /= powersOfTen[-exponent];
+        else
+            value *= powersOfTen[exponent];
+        return negative ? -value : value;
+    }
 
-    m_size = bounds * scale;
+    bool ok;
+    const double value = QByteArray::fromRawData(pos, end - pos).toDouble(&ok);
+    return ok ? value : 0;
+}
 
-    m_normals.resize(m_points.size());
-    for (int i = 0; i < m_pointIndices.size(); i += 3) {
-        const QVector3D a = m_points.at(m_pointIndices.at(i));
-        const QVector3D b = m_points.at(m_pointIndices.at(i+1));
-        const QVector3D c = m_points.at(m_pointIndices.at(i+2));
+// the vertex index of a face vertex like "12", "12/3" or "12/3/4",
+// zero if it can't be parsed
+static int parseVertexIndex(const char *pos, const char *end)
+{
+    bool negative = false;
+    if (pos < end && (*pos == '-' || *pos == '+'))
+        negative = *pos++ == '-';
 
-        const QVector3D normal = QVector3D::crossProduct(b - a, c - a).normalized();
+    const char *digitsStart = pos;
+    int value = 0;
+    for (; pos < end && *pos >= '0' && *pos <= '9'; ++pos)
+        value = value * 10 + (*pos - '0');
 
-        for (int j = 0; j < 3; ++j)
-            m_normals[m_pointIndices.at(i + j)] += normal;
+    if (pos == digitsStart || (pos < end && *pos != '/'))
+        return 0;
+
+    return negative ? -value : value;
+}
+
+void Model::parseMapped(QFile &file, QVector3D &boundsMin, QVector3D &boundsMax)
+{
+    const qint64 size = file.size();
+
+    QByteArray buffer;
+    const char *data = reinterpret_cast<const char *>(size > 0 ? file.map(0, size) : 0);
+    if (!data) {
+        buffer = file.readAll();
+        data = buffer.constData();
     }
 
-    for (int i = 0; i < m_normals.size(); ++i)
-        m_normals[i] = m_normals[i].normalized();
+    const char *end = data + (buffer.isNull() ? size : buffer.size());
+
+    const char *pos = data;
+    while (pos < end) {
+        const char *lineEnd = static_cast<const char *>(memchr(pos, '\n', end - pos));
+        if (!lineEnd)
+            lineEnd = end;
+
+        const char *idStart = skipSpace(pos, lineEnd);
+        const char *idEnd = tokenEnd(idStart, lineEnd);
+        const int idLength = idEnd - idStart;
+
+        if (idLength == 1 && idStart[0] == 'v') {
+            QVector3D p;
+            const char *token = idEnd;
+            for (int i = 0; i < 3; ++i) {
+                token = skipSpace(token, lineEnd);
+                const char *next = tokenEnd(token, lineEnd);
+                ((float *)&p)[i] = token < next ? float(parseReal(token, next)) : 0.0f;
+                token = next;
+
+                ((float *)&boundsMin)[i] = qMin(((float *)&boundsMin)[i], ((float *)&p)[i]);
+                ((float *)&boundsMax)[i] = qMax(((float *)&boundsMax)[i], ((float *)&p)[i]);
+            }
+            m_points << p;
+        } else if ((idLength == 1 && idStart[0] == 'f')
+                   || (idLength == 2 && idStart[0] == 'f' && idStart[1] == 'o'))
+        {
+            QVarLengthArray<int, 4> p;
+
+            const char *token = skipSpace(idEnd, lineEnd);
+            while (token < lineEnd) {
+                const char *next = tokenEnd(token, lineEnd);
+                const int vertexIndex = parseVertexIndex(token, next);
+                if (vertexIndex)
+                    p.append(vertexIndex > 0 ? vertexIndex - 1 : m_points.size() + vertexIndex);
+                token = skipSpace(next, lineEnd);
+            }
+
+            if (p.size() >= 3)
+                addFace(p.constData(), p.size());
+        }
+
+        pos = lineEnd + 1;
+    }
+
+    if (buffer.isNull())
+        file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+}
+
+static const char meshCacheMagic[4] = { 'W', 'Q', 'M', 'C' };
+static const quint32 meshCacheVersion = 1;
+static const quint32 meshCacheByteOrder = 0x01020304;
+
+static int meshCacheAlign(qint64 size)
+{
+    return (size + 3) & ~3;
+}
+
+QString Model::cacheFileName(const QString &filePath)
+{
+    return filePath + QLatin1String(".meshcache");
+}
+
+bool Model::loadCache(const QFileInfo &source)
+{
+    QFile file(cacheFileName(source.filePath()));
+    if (!source.exists() || !file.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 size = file.size();
+    if (size < qint64(sizeof(MeshCacheHeader)))
+        return false;
+
+    const uchar *data = file.map(0, size);
+    if (!data)
+        return false;
+
+    const MeshCacheHeader *header = reinterpret_cast<const MeshCacheHeader *>(data);
+    if (memcmp(header->magic, meshCacheMagic, sizeof(meshCacheMagic))
+        || header->version != meshCacheVersion
+        || header->byteOrder != meshCacheByteOrder
+        || header->indexSize != sizeof(IndexType)
+        || header->sourceSize != source.size()
+        || header->sourceModified != source.lastModified().toMSecsSinceEpoch()
+        || header->triangleIndexCount % 3 || header->edgeIndexCount % 2)
+    {
+        return false;
+    }
+
+    const qint64 pointBytes = qint64(header->pointCount) * sizeof(QVector3D);
+    const qint64 triangleBytes = qint64(header->triangleIndexCount) * header->indexSize;
+    const qint64 edgeBytes = qint64(header->edgeIndexCount) * header->indexSize;
+
+    if (size < qint64(sizeof(MeshCacheHeader)) + 2 * pointBytes
+               + meshCacheAlign(triangleBytes) + edgeBytes)
+        return false;
+
+    const uchar *pos = data + sizeof(MeshCacheHeader);
+
+    QVector<QVector3D> points(header->pointCount);
+    memcpy(points.data(), pos, pointBytes);
+    pos += pointBytes;
+
+    QVector<QVector3D> normals(header->pointCount);
+    memcpy(normals.data(), pos, pointBytes);
+    pos += pointBytes;
+
+    QVector<IndexType> pointIndices(header->triangleIndexCount);
+    memcpy(pointIndices.data(), pos, triangleBytes);
+    pos += meshCacheAlign(triangleBytes);
+
+    QVector<IndexType> edgeIndices(header->edgeIndexCount);
+    memcpy(edgeIndices.data(), pos, edgeBytes);
+
+    // a damaged cache must not make render() read out of bounds
+    for (int i = 0; i < pointIndices.size(); ++i)
+        if (pointIndices.at(i) >= header->pointCount)
+            return false;
+    for (int i = 0; i < edgeIndices.size(); ++i)
+        if (edgeIndices.at(i) >= header->pointCount)
+            return false;
+
+    m_points = points;
+    m_normals = normals;
+    m_pointIndices = pointIndices;
+    m_edgeIndices = edgeIndices;
+    m_size = QVector3D(header->size[0], header->size[1], header->size[2]);
+    return true;
+}
+
+void Model::saveCache(const QFileInfo &source) const
+{
+    const QString fileName = cacheFileName(source.filePath());
+    const QString tempName = fileName + QLatin1String(".tmp");
+
+    // write to a temporary file first so a concurrent load never sees a
+    // partially written cache
+    QFile file(tempName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return;
+
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, meshCacheMagic, sizeof(meshCacheMagic));
+    header.version = meshCacheVersion;
+    header.byteOrder = meshCacheByteOrder;
+    header.indexSize = sizeof(IndexType);
+    header.sourceSize = source.size();
+    header.sourceModified = source.lastModified().toMSecsSinceEpoch();
+    header.pointCount = m_points.size();
+    header.triangleIndexCount = m_pointIndices.size();
+    header.edgeIndexCount = m_edgeIndices.size();
+    header.size[0] = m_size.x();
+    header.size[1] = m_size.y();
+    header.size[2] = m_size.z();
+
+    const qint64 triangleBytes = qint64(m_pointIndices.size()) * header.indexSize;
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(m_points.constData()), m_points.size() * sizeof(QVector3D));
+    file.write(reinterpret_cast<const char *>(m_normals.constData()), m_normals.size() * sizeof(QVector3D));
+    file.write(reinterpret_cast<const char *>(m_pointIndices.constData()), triangleBytes);
+    file.write(QByteArray(meshCacheAlign(triangleBytes) - triangleBytes, 0));
+    file.write(reinterpret_cast<const char *>(m_edgeIndices.constData()),
+               m_edgeIndices.size() * header.indexSize);
+    file.close();
+
+    if (file.error() != QFile::NoError) {
+        QFile::remove(tempName);
+        return;
+    }
+
+    QFile::remove(fileName);
+    if (!QFile::rename(tempName, fileName))
+        QFile::remove(tempName);
 }
 
 QVector3D Model::size() const
@@ -129,6 +464,50 @@ QVector3D Model::size() const
     return m_size;
 }
 
+#ifndef QT_NO_OPENGL
+// Binds the vertex buffer, uploading the geometry first if this is the first
+// render or the buffers belong to another context. Returns false if buffer
+// objects aren't available, in which case client side arrays are used.
+bool Model::bindBuffers() const
+{
+    const QGLContext *context = QGLContext::currentContext();
+    if (!context || m_points.isEmpty())
+        return false;
+
+    if (m_vertexBuffer.isCreated() && m_vertexBuffer.bufferId() && m_bufferContext == context)
+        return m_vertexBuffer.bind();
+
+    m_vertexBuffer.destroy();
+    m_triangleBuffer.destroy();
+    m_edgeBuffer.destroy();
+    m_bufferContext = 0;
+
+    if (!m_vertexBuffer.create() || !m_triangleBuffer.create() || !m_edgeBuffer.create())
+        return false;
+
+    const int pointBytes = m_points.size() * sizeof(QVector3D);
+
+    m_vertexBuffer.setUsagePattern(QGLBuffer::StaticDraw);
+    m_vertexBuffer.bind();
+    m_vertexBuffer.allocate(2 * pointBytes);
+    m_vertexBuffer.write(0, m_points.constData(), pointBytes);
+    m_vertexBuffer.write(pointBytes, m_normals.constData(), pointBytes);
+
+    m_triangleBuffer.setUsagePattern(QGLBuffer::StaticDraw);
+    m_triangleBuffer.bind();
+    m_triangleBuffer.allocate(m_pointIndices.constData(),
+                              m_pointIndices.size() * sizeof(m_pointIndices.at(0)));
+
+    m_edgeBuffer.setUsagePattern(QGLBuffer::StaticDraw);
+    m_edgeBuffer.bind();
+    m_edgeBuffer.allocate(m_edgeIndices.constData(),
+                          m_edgeIndices.size() * sizeof(m_edgeIndices.at(0)));
+
+    m_bufferContext = context;
+    return true;
+}
+#endif
+
 void Model::render(bool wireframe, bool normals) const
 {
 #ifdef QT_NO_OPENGL
@@ -148,13 +527,30 @@ void Model::render(bool wireframe, bool normals) const
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (float *)m_points.data());
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (float *)m_normals.data());
+    if (bindBuffers()) {
+        const quintptr normalOffset = m_points.size() * sizeof(QVector3D);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<void *>(normalOffset));
+
+        if (wireframe) {
+            m_edgeBuffer.bind();
+            glDrawElements(GL_LINES, m_edgeIndices.size(), elementType, 0);
+        } else {
+            m_triangleBuffer.bind();
+            glDrawElements(GL_TRIANGLES, m_pointIndices.size(), elementType, 0);
+        }
 
-    if (wireframe)
-        glDrawElements(GL_LINES, m_edgeIndices.size(), elementType, m_edgeIndices.data());
-    else
-        glDrawElements(GL_TRIANGLES, m_pointIndices.size(), elementType, m_pointIndices.data());
+        QGLBuffer::release(QGLBuffer::VertexBuffer);
+        QGLBuffer::release(QGLBuffer::IndexBuffer);
+    } else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (float *)m_points.data());
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (float *)m_normals.data());
+
+        if (wireframe)
+            glDrawElements(GL_LINES, m_edgeIndices.size(), elementType, m_edgeIndices.data());
+        else
+            glDrawElements(GL_TRIANGLES, m_pointIndices.size(), elementType, m_pointIndices.data());
+    }
 
     if (normals) {
         QVector<QVector3D> points;
@@ -35,6 +35,8 @@ POSSIBILITY OF SUCH DAMAGE."
 #ifndef MODEL_H
 #define MODEL_H
 
+#include <QFile>
+#include <QFileInfo>
 #include <QPainter>
 #include <QString>
 #include <QVector>
@@ -44,11 +46,32 @@ POSSIBILITY OF SUCH DAMAGE."
 #include <QMatrix4x4>
 #include <QVector3D>
 
+#ifndef QT_NO_OPENGL
+#include <QGLBuffer>
+#endif
+
 class Model
 {
 public:
-    Model() {}
-    Model(const QString &filePath);
+#ifdef QT_OPENGL_ES_2
+    typedef ushort IndexType;
+#else
+    typedef uint IndexType;
+#endif
+
+    enum Parser
+    {
+        MappedParser,
+        TextStreamParser
+    };
+
+    Model();
+    // Unless useCache is false, the parsed mesh is written to a binary
+    // cache next to the source, which is used instead of parsing as long
+    // as the source file's size and modification time are unchanged.
+    Model(const QString &filePath, Parser parser = MappedParser, bool useCache = true);
+
+    static QString cacheFileName(const QString &filePath);
 
     void render(bool wireframe = false, bool normals = false) const;
     void render(QPainter *painter, const QMatrix4x4 &matrix, bool normals = false) const;
@@ -60,24 +83,65 @@ public:
 
     QVector3D size() const;
 
+    const QVector<QVector3D> &vertexData() const { return m_points; }
+    const QVector<QVector3D> &normalData() const { return m_normals; }
+    const QVector<IndexType> &triangleIndexData() const { return m_pointIndices; }
+    const QVector<IndexType> &edgeIndexData() const { return m_edgeIndices; }
+
 private:
+    // Layout, all values in host byte order:
+    //   header      MeshCacheHeader
+    //   points      pointCount * QVector3D, normalized
+    //   normals     pointCount * QVector3D
+    //   triangles   triangleIndexCount indices, padded to four bytes
+    //   edges       edgeIndexCount indices
+    struct MeshCacheHeader
+    {
+        char magic[4];
+        quint32 version;
+        quint32 byteOrder;
+        quint32 indexSize;
+        qint64 sourceSize;
+        qint64 sourceModified;
+        quint32 pointCount;
+        quint32 triangleIndexCount;
+        quint32 edgeIndexCount;
+        float size[3];
+        quint32 reserved[2];
+    };
+
+    bool loadCache(const QFileInfo &source);
+    void saveCache(const QFileInfo &source) const;
+
+    void parseTextStream(QFile &file, QVector3D &boundsMin, QVector3D &boundsMax);
+    void parseMapped(QFile &file, QVector3D &boundsMin, QVector3D &boundsMax);
+    void addFace(const int *p, int count);
+
+#ifndef QT_NO_OPENGL
+    bool bindBuffers() const;
+#endif
+
     QString m_fileName;
 
     QVector<QVector3D> m_points;
     QVector<QVector3D> m_normals;
 
-#ifdef QT_OPENGL_ES_2
-    QVector<ushort> m_edgeIndices;
-    QVector<ushort> m_pointIndices;
-#else
-    QVector<uint> m_edgeIndices;
-    QVector<uint> m_pointIndices;
-#endif
+    QVector<IndexType> m_edgeIndices;
+    QVector<IndexType> m_pointIndices;
 
     QVector3D m_size;
 
     mutable QVector<QLineF> m_lines;
     mutable QVector<QVector3D> m_mapped;
+
+#ifndef QT_NO_OPENGL
+    // geometry uploaded on first render in a context, shared between copies
+    // and released with the last one
+    mutable const QGLContext *m_bufferContext;
+    mutable QGLBuffer m_vertexBuffer;
+    mutable QGLBuffer m_triangleBuffer;
+    mutable QGLBuffer m_edgeBuffer;
+#endif
 };
 
 #endif
@@ -38,6 +38,8 @@ POSSIBILITY OF SUCH DAMAGE."
 #include <QtGui>
 
 #include "mazescene.h"
+#include "frameprofiler.h"
+#include "tracerecorder.h"
 
 #ifndef QT_NO_OPENGL
 #if !defined QT_OPENGL_ES_2 && !defined Q_WS_MAC
@@ -111,6 +113,8 @@ void ModelItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidg
     if (!m_model || isObscured())
         return;
 
+    ProfileScope scope(FrameProfiler::ModelPaint);
+
     QMatrix4x4 projectionMatrix = QMatrix4x4(painter->transform()) * fromProjection(70);
 
     const int delta = m_time.elapsed() - m_lastTime;
@@ -189,7 +193,7 @@ void ModelItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidg
 
 
 ModelItem::ModelItem()
-    : ProjectedItem(QRectF(), false, false)
+    : ProjectedItem(QRectF(), false)
     , m_wireframeEnabled(false)
     , m_normalsEnabled(false)
     , m_modelColor(153, 255, 0)
@@ -228,6 +232,7 @@ ModelItem::ModelItem()
 
 static Model *loadModel(const QString &filePath)
 {
+    TraceScope trace("load model", "io", filePath);
     return new Model(filePath);
 }
 
@@ -35,6 +35,7 @@ POSSIBILITY OF SUCH DAMAGE."
 #include "scriptwidget.h"
 #include "mazescene.h"
 #include "entity.h"
+#include "tracerecorder.h"
 
 static QScriptValue qsRand(QScriptContext *, QScriptEngine *engine)
 {
@@ -89,6 +90,8 @@ void ScriptWidget::setPreset(int preset)
 ScriptWidget::ScriptWidget(MazeScene *scene, Entity *entity)
     : m_scene(scene)
     , m_entity(entity)
+    , m_tickTime(0)
+    , m_ticks(0)
 {
     new QVBoxLayout(this);
 
@@ -131,8 +134,10 @@ ScriptWidget::ScriptWidget(MazeScene *scene, Entity *entity)
 
 void ScriptWidget::timerEvent(QTimerEvent *)
 {
+    TraceScope trace("script tick", "script");
+
     QPointF player = m_scene->camera().pos();
-    QPointF entity = m_entity->pos();
+    QPointF entity = m_entity->drawnPos();
 
     QScriptValue px(m_engine, player.x());
     QScriptValue py(m_engine, player.y());
@@ -146,16 +151,45 @@ void ScriptWidget::timerEvent(QTimerEvent *)
     m_engine->globalObject().setProperty("my_y", ey);
     m_engine->globalObject().setProperty("time", time);
 
-    m_engine->evaluate(m_source);
-    if (m_engine->hasUncaughtException()) {
-        QString text = m_engine->uncaughtException().toString();
-        m_statusView->setText(text);
-    }
+    QElapsedTimer timer;
+    timer.start();
+
+    m_engine->evaluate(m_program);
+
+    // running average of the time spent in the script, in milliseconds
+    const qreal elapsed = timer.nsecsElapsed() / 1000000.0;
+    m_tickTime = m_ticks ? 0.9 * m_tickTime + 0.1 * elapsed : elapsed;
+
+    if (m_engine->hasUncaughtException())
+        setStatus(m_engine->uncaughtException().toString());
+
+    // refresh the timing twice a second
+    if (++m_ticks % 10 == 0)
+        updateStatusView();
 }
 
 void ScriptWidget::display(QScriptValue value)
 {
-    m_statusView->setText(value.toString());
+    setStatus(value.toString());
+}
+
+void ScriptWidget::setStatus(const QString &status)
+{
+    if (m_status == status)
+        return;
+
+    m_status = status;
+    updateStatusView();
+}
+
+void ScriptWidget::updateStatusView()
+{
+    QString text = m_status;
+    if (m_ticks)
+        text += QString::fromLatin1(" [%0 ms/tick]").arg(m_tickTime, 0, 'f', 3);
+
+    if (m_statusView->text() != text)
+        m_statusView->setText(text);
 }
 
 void ScriptWidget::updateSource()
@@ -166,10 +200,16 @@ void ScriptWidget::updateSource()
 
     m_time.restart();
     m_source = m_sourceEdit->toPlainText();
+
+    // compile once, the timer runs the cached program
+    m_program = QScriptProgram(m_source, QLatin1String("script"));
+    m_ticks = 0;
+
+    const QScriptSyntaxCheckResult result = QScriptEngine::checkSyntax(m_source);
     if (wasEvaluating)
-        m_statusView->setText(QLatin1String("Aborted long running evaluation!"));
-    else if (m_engine->canEvaluate(m_source))
-        m_statusView->setText(QLatin1String("Evaluation succeeded"));
+        setStatus(QLatin1String("Aborted long running evaluation!"));
+    else if (result.state() == QScriptSyntaxCheckResult::Valid)
+        setStatus(QLatin1String("Evaluation succeeded"));
     else
-        m_statusView->setText(QLatin1String("Evaluation failed"));
+        setStatus(QLatin1String("Evaluation failed: ") + result.errorMessage());
 }
@@ -35,7 +35,9 @@ POSSIBILITY OF SUCH DAMAGE."
 #ifndef SCRIPTWIDGET_H
 #define SCRIPTWIDGET_H
 
+#include <QElapsedTimer>
 #include <QScriptEngine>
+#include <QScriptProgram>
 #include <QtGui>
 
 class MazeScene;
@@ -58,13 +60,21 @@ protected:
     void timerEvent(QTimerEvent *event);
 
 private:
+    void setStatus(const QString &status);
+    void updateStatusView();
+
     MazeScene *m_scene;
     Entity *m_entity;
     QScriptEngine *m_engine;
     QPlainTextEdit *m_sourceEdit;
     QLineEdit *m_statusView;
     QString m_source;
+    QScriptProgram m_program;
     QTime m_time;
+
+    QString m_status;
+    qreal m_tickTime;
+    int m_ticks;
 };
 
 #endif
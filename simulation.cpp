@@ -0,0 +1,96 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include "simulation.h"
+
+Simulation::Simulation(MazeScene *scene)
+    : m_scene(scene)
+    , m_stopped(0)
+    , m_woken(false)
+{
+}
+
+Simulation::~Simulation()
+{
+    stop();
+}
+
+void Simulation::stop()
+{
+    m_stopped = 1;
+    wake();
+    wait();
+}
+
+void Simulation::wake()
+{
+    QMutexLocker locker(&m_wakeLock);
+    m_woken = true;
+    m_wakeCondition.wakeOne();
+}
+
+void Simulation::run()
+{
+    const int stepSize = MazeScene::SimulationStep;
+    bool wasStill = true;
+
+    while (!m_stopped) {
+        const long time = m_scene->elapsed();
+        FrameSnapshot &snapshot = m_snapshots.writeBuffer();
+        if (m_scene->stepSimulation(time, &snapshot)) {
+            const bool still = snapshot.still;
+            m_snapshots.publish();
+
+            // the GUI thread stops asking for frames while things are still
+            if (wasStill && !still)
+                QMetaObject::invokeMethod(m_scene, "requestFrame", Qt::QueuedConnection);
+            wasStill = still;
+
+            if (still) {
+                QMutexLocker locker(&m_wakeLock);
+                while (!m_woken && !m_stopped)
+                    m_wakeCondition.wait(&m_wakeLock);
+                m_woken = false;
+                locker.unlock();
+
+                // don't catch up with the time spent sleeping
+                m_scene->skipSimulation(m_scene->elapsed());
+                continue;
+            }
+        }
+
+        // sleep until the next step is due
+        usleep((stepSize - time % stepSize) * 1000);
+    }
+}
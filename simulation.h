@@ -0,0 +1,150 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "mazescene.h"
+
+// Where an entity is and which sprite frame it shows.
+struct EntityPose
+{
+    EntityPose() : angle(0), walked(false), animationIndex(0) {}
+
+    QPointF pos;
+    qreal angle;
+    bool walked;
+    int animationIndex;
+};
+
+// The state of the simulation after a step, everything the GUI thread
+// needs to draw a frame. Entities are in the order they were added. The
+// state of the step before is kept as well, so frames drawn between steps
+// can interpolate.
+struct FrameSnapshot
+{
+    FrameSnapshot() : time(0), doorValue(1), still(true) {}
+
+    // simulation time of the newest state
+    long time;
+    Camera camera;
+    Camera previousCamera;
+    QVector<EntityPose> entities;
+    QVector<EntityPose> previousEntities;
+    // door animation value, 1 when closed and 0 when open
+    qreal doorValue;
+    // nothing moved in the last step and the doors are at rest
+    bool still;
+};
+
+// Hands values from one writer thread to one reader thread without
+// locking. The writer fills writeBuffer() and publishes it, the reader
+// takes the latest published value and older ones are dropped.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : m_write(0), m_shared(1), m_read(2), m_taken(false) {}
+
+    T &writeBuffer() { return m_buffers[m_write]; }
+
+    void publish()
+    {
+        m_write = m_shared.fetchAndStoreOrdered(m_write | Fresh) & IndexMask;
+    }
+
+    // the latest value, or 0 if nothing was published since the last call
+    const T *take()
+    {
+        if (!(int(m_shared) & Fresh))
+            return 0;
+        m_read = m_shared.fetchAndStoreOrdered(m_read) & IndexMask;
+        m_taken = true;
+        return &m_buffers[m_read];
+    }
+
+    // like take(), but falls back to the value taken last
+    const T *latest()
+    {
+        if (const T *value = take())
+            return value;
+        return m_taken ? &m_buffers[m_read] : 0;
+    }
+
+private:
+    enum { IndexMask = 3, Fresh = 4 };
+
+    T m_buffers[3];
+    int m_write;
+    QAtomicInt m_shared;
+    int m_read;
+    bool m_taken;
+};
+
+// Runs the fixed step simulation of a scene on its own thread, so slow
+// painting doesn't hold it up. Each batch of steps is published as a
+// FrameSnapshot for the GUI thread to pick up. The thread sleeps while
+// the simulation is still, until wake() is called.
+class Simulation : public QThread
+{
+public:
+    Simulation(MazeScene *scene);
+    ~Simulation();
+
+    void stop();
+    void wake();
+
+    // the latest snapshot, or 0 if none was published yet
+    const FrameSnapshot *latestSnapshot() { return m_snapshots.latest(); }
+
+protected:
+    void run();
+
+private:
+    MazeScene *m_scene;
+    TripleBuffer<FrameSnapshot> m_snapshots;
+    QAtomicInt m_stopped;
+
+    QMutex m_wakeLock;
+    QWaitCondition m_wakeCondition;
+    bool m_woken;
+};
+
+#endif
@@ -0,0 +1,178 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include "spanbuffer.h"
+#include "mazescene.h"
+
+#include <limits>
+
+SpanBuffer::SpanBuffer()
+{
+    m_spans.reserve(64);
+    clear();
+}
+
+void SpanBuffer::clear()
+{
+    Span span;
+    span.item = 0;
+    span.sx1 = -std::numeric_limits<float>::infinity();
+    span.sx2 =  std::numeric_limits<float>::infinity();
+    span.cy = std::numeric_limits<float>::infinity();
+
+    // resize() instead of clear() to keep the reserved storage
+    m_spans.resize(1);
+    m_spans[0] = span;
+}
+
+// returns the index of the first span ending after x
+int SpanBuffer::find(float x) const
+{
+    int low = 0;
+    int high = m_spans.size();
+    while (low < high) {
+        const int mid = (low + high) / 2;
+        if (m_spans.at(mid).sx2 > x)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    return low;
+}
+
+// makes sure a span starts at x, returns the index of that span
+int SpanBuffer::split(float x)
+{
+    const int i = find(x);
+    if (i == m_spans.size() || m_spans.at(i).sx1 >= x)
+        return i;
+
+    Span split = m_spans.at(i);
+    m_spans[i].sx2 = x;
+    split.sx1 = x;
+    m_spans.insert(i + 1, split);
+    return i + 1;
+}
+
+// joins neighbouring spans in the range [first, last] that are covered
+// by the same item at the same depth
+void SpanBuffer::merge(int first, int last)
+{
+    first = qMax(first, 0);
+    last = qMin(last, m_spans.size() - 1);
+    if (first >= last)
+        return;
+
+    int out = first;
+    for (int i = first + 1; i <= last; ++i) {
+        const Span &span = m_spans.at(i);
+        Span &previous = m_spans[out];
+        if (span.item == previous.item && span.cy == previous.cy)
+            previous.sx2 = span.sx2;
+        else
+            m_spans[++out] = span;
+    }
+
+    if (out < last)
+        m_spans.remove(out + 1, last - out);
+}
+
+bool SpanBuffer::insert(const Span &span, bool checkOnly)
+{
+    const int left = split(span.sx1);
+    const int right = split(span.sx2);
+
+    bool visible = false;
+    for (int i = left; i < right; ++i) {
+        Span &s = m_spans[i];
+        if (s.cy > span.cy) {
+            visible = true;
+            if (!checkOnly) {
+                s.item = span.item;
+                s.cy = span.cy;
+            }
+        }
+    }
+
+    if (!checkOnly)
+        merge(left - 1, right);
+    return visible;
+}
+
+bool SpanBuffer::insert(ProjectedItem *item, const QTransform &cameraTransform, bool checkOnly)
+{
+    // merged wall runs are inserted a cell at a time, so each piece is
+    // compared at its own depth instead of the depth of the run's middle
+    const QPointF a = item->a();
+    const QPointF b = item->b();
+    const int pieces = qMax(1, qRound(QLineF(a, b).length()));
+
+    bool visible = false;
+    for (int i = 0; i < pieces; ++i) {
+        const QPointF pa = a + (b - a) * i / pieces;
+        const QPointF pb = a + (b - a) * (i + 1) / pieces;
+        if (insertSegment(item, cameraTransform.map(pa), cameraTransform.map(pb), checkOnly))
+            visible = true;
+    }
+    return visible;
+}
+
+// inserts the segment from ca to cb, given in camera space
+bool SpanBuffer::insertSegment(ProjectedItem *item, QPointF ca, QPointF cb, bool checkOnly)
+{
+    if (ca.y() <= 0 && cb.y() <= 0)
+        return false;
+
+    const float clip = 0.0001;
+    if (ca.y() <= 0) {
+        float t = (clip - ca.y()) / (cb.y() - ca.y());
+        ca.setX(ca.x() + t * (cb.x() - ca.x()));
+        ca.setY(clip);
+    } else if(cb.y() <= 0) {
+        float t = (clip - ca.y()) / (cb.y() - ca.y());
+        cb.setX(ca.x() + t * (cb.x() - ca.x()));
+        cb.setY(clip);
+    }
+
+    Span span;
+    span.item = item;
+    span.sx1 = ca.x() / ca.y();
+    span.sx2 = cb.x() / cb.y();
+    span.cy = (ca.y() + cb.y()) * 0.5f;
+
+    if (span.sx1 >= span.sx2)
+        qSwap(span.sx1, span.sx2);
+
+    return insert(span, checkOnly);
+}
@@ -0,0 +1,82 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#ifndef SPANBUFFER_H
+#define SPANBUFFER_H
+
+#include <QPointF>
+#include <QTransform>
+#include <QVector>
+
+class ProjectedItem;
+
+struct Span
+{
+    ProjectedItem *item;
+
+    // screen coordinates
+    float sx1;
+    float sx2;
+
+    float cy;
+};
+
+// Sorted, gap-free list of screen space spans, each remembering the
+// closest item covering it. Spans are kept in a flat array ordered by
+// sx1, so locating the span containing a screen coordinate is a binary
+// search, and neighbouring spans owned by the same item are merged back
+// together to keep the array short.
+class SpanBuffer
+{
+public:
+    SpanBuffer();
+
+    void clear();
+
+    bool insert(const Span &span, bool checkOnly);
+    bool insert(ProjectedItem *item, const QTransform &cameraTransform, bool checkOnly);
+
+    int size() const { return m_spans.size(); }
+    const Span &at(int i) const { return m_spans.at(i); }
+
+private:
+    bool insertSegment(ProjectedItem *item, QPointF ca, QPointF cb, bool checkOnly);
+    int find(float x) const;
+    int split(float x);
+    void merge(int first, int last);
+
+    QVector<Span> m_spans;
+};
+
+#endif
@@ -0,0 +1,131 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include "tilemap.h"
+
+#include <qmath.h>
+
+TileMap::TileMap()
+    : m_width(0)
+    , m_height(0)
+{
+}
+
+TileMap::TileMap(const char *map, int width, int height)
+    : m_width(width)
+    , m_height(height)
+{
+    m_types.resize(width * height);
+    for (int i = 0; i < width * height; ++i)
+        m_types[i] = char(typeFromChar(map[i]));
+}
+
+TileMap::TileMap(int width, int height, int type)
+    : m_width(width)
+    , m_height(height)
+    , m_types(width * height, char(type))
+{
+}
+
+TileMap TileMap::fromRawData(const char *types, int width, int height)
+{
+    TileMap map;
+    map.m_width = width;
+    map.m_height = height;
+    map.m_types = QByteArray::fromRawData(types, width * height);
+    return map;
+}
+
+int TileMap::typeFromChar(char c)
+{
+    switch (c) {
+    case ' ':
+        return Empty;
+    case '-':
+        return Door;
+    case '#':
+        return Wall;
+    case '&':
+        return 1;
+    case '@':
+        return 2;
+    case '%':
+        return 3;
+    case '$':
+        return 4;
+    case '?':
+        return 5;
+    case '!':
+        return 6;
+    case '=':
+        return 7;
+    case '*':
+        return 8;
+    case '/':
+        return 9;
+    case '.':
+        return 10;
+    default:
+        return Wall;
+    }
+}
+
+GridRay::GridRay(const QPointF &origin, const QPointF &direction)
+    : m_x(qFloor(origin.x()))
+    , m_y(qFloor(origin.y()))
+    , m_stepX(direction.x() < 0 ? -1 : 1)
+    , m_stepY(direction.y() < 0 ? -1 : 1)
+    , m_side(TileMap::North)
+    , m_deltaX(direction.x() == 0 ? 1e30 : qAbs(1 / direction.x()))
+    , m_deltaY(direction.y() == 0 ? 1e30 : qAbs(1 / direction.y()))
+    , m_distance(0)
+{
+    m_sideX = (m_stepX < 0 ? origin.x() - m_x : m_x + 1 - origin.x()) * m_deltaX;
+    m_sideY = (m_stepY < 0 ? origin.y() - m_y : m_y + 1 - origin.y()) * m_deltaY;
+}
+
+void GridRay::next()
+{
+    if (m_sideX < m_sideY) {
+        m_distance = m_sideX;
+        m_sideX += m_deltaX;
+        m_x += m_stepX;
+        m_side = m_stepX < 0 ? TileMap::West : TileMap::East;
+    } else {
+        m_distance = m_sideY;
+        m_sideY += m_deltaY;
+        m_y += m_stepY;
+        m_side = m_stepY < 0 ? TileMap::North : TileMap::South;
+    }
+}
@@ -0,0 +1,134 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include <QByteArray>
+#include <QPointF>
+
+// Grid of cell types as used by MazeScene, one signed byte per cell.
+// Negative types are cells the player can stand in, everything from
+// Door upwards gets a wall face towards its open neighbours.
+class TileMap
+{
+public:
+    enum Type
+    {
+        Empty = -2,
+        Door = -1,
+        Wall = 0,
+        // the highest wall type, see WallItem
+        LastWallType = 10
+    };
+
+    enum Side
+    {
+        North,
+        South,
+        West,
+        East
+    };
+
+    TileMap();
+    TileMap(const char *map, int width, int height);
+    TileMap(int width, int height, int type = Wall);
+
+    // wraps the types without copying, the data must outlive the map
+    static TileMap fromRawData(const char *types, int width, int height);
+
+    static int typeFromChar(char c);
+    static int opposite(int side) { return side ^ 1; }
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    const char *data() const { return m_types.constData(); }
+
+    bool contains(int x, int y) const
+    {
+        return x >= 0 && y >= 0 && x < m_width && y < m_height;
+    }
+
+    // cells outside the map are treated as plain walls
+    int type(int x, int y) const
+    {
+        if (!contains(x, y))
+            return Wall;
+        return qint8(m_types.at(y * m_width + x));
+    }
+
+    void setType(int x, int y, int type)
+    {
+        if (contains(x, y))
+            m_types[y * m_width + x] = char(type);
+    }
+
+private:
+    int m_width;
+    int m_height;
+    QByteArray m_types;
+};
+
+// Visits the cells along a ray in order, using a DDA walk.
+class GridRay
+{
+public:
+    GridRay(const QPointF &origin, const QPointF &direction);
+
+    int x() const { return m_x; }
+    int y() const { return m_y; }
+
+    // steps into the next cell, side() is the side of the previous cell
+    // that was crossed and distance() the ray parameter at the crossing
+    void next();
+
+    int side() const { return m_side; }
+    qreal distance() const { return m_distance; }
+
+private:
+    int m_x;
+    int m_y;
+    int m_stepX;
+    int m_stepY;
+    int m_side;
+
+    qreal m_deltaX;
+    qreal m_deltaY;
+    qreal m_sideX;
+    qreal m_sideY;
+    qreal m_distance;
+};
+
+#endif
@@ -0,0 +1,189 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include "tracerecorder.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThread>
+
+QAtomicInt TraceRecorder::s_recording(0);
+
+TraceRecorder::TraceRecorder()
+    : m_mainThread(0)
+    , m_overflowed(false)
+{
+}
+
+TraceRecorder *TraceRecorder::instance()
+{
+    static TraceRecorder recorder;
+    return &recorder;
+}
+
+QString TraceRecorder::defaultFileName()
+{
+    return QString("wolfenqt-trace-%0.json")
+        .arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"));
+}
+
+void TraceRecorder::start(const QString &fileName)
+{
+    QMutexLocker locker(&m_mutex);
+    if (s_recording)
+        return;
+
+    m_fileName = fileName;
+    m_events.clear();
+    m_details.clear();
+    m_threads.clear();
+    m_mainThread = 0;
+    m_overflowed = false;
+    m_clock.start();
+
+    s_recording = 1;
+}
+
+void TraceRecorder::stop()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!s_recording)
+            return;
+        s_recording = 0;
+    }
+
+    if (m_overflowed)
+        qWarning() << "Trace reached" << int(MaxEvents) << "events, later events were dropped";
+
+    if (!save(m_fileName))
+        qWarning() << "Failed to write trace" << m_fileName;
+
+    m_events.clear();
+    m_details.clear();
+}
+
+void TraceRecorder::addEvent(const char *name, const char *category, qint64 begin, qint64 end,
+                             const QString &detail)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!s_recording)
+        return;
+
+    if (m_events.size() >= MaxEvents) {
+        m_overflowed = true;
+        return;
+    }
+
+    const Qt::HANDLE threadId = QThread::currentThreadId();
+    QHash<Qt::HANDLE, int>::const_iterator it = m_threads.constFind(threadId);
+    if (it == m_threads.constEnd()) {
+        it = m_threads.insert(threadId, m_threads.size() + 1);
+
+        QCoreApplication *app = QCoreApplication::instance();
+        if (app && QThread::currentThread() == app->thread())
+            m_mainThread = it.value();
+    }
+
+    Event event;
+    event.name = name;
+    event.category = category;
+    event.begin = begin;
+    event.duration = end - begin;
+    event.thread = it.value();
+    event.detail = -1;
+
+    if (!detail.isEmpty()) {
+        event.detail = m_details.size();
+        m_details << detail;
+    }
+
+    m_events << event;
+}
+
+static QString escaped(const QString &text)
+{
+    QString result;
+    result.reserve(text.size());
+    foreach (const QChar &c, text) {
+        if (c == '"' || c == '\\')
+            result += '\\';
+        if (c.unicode() < 0x20)
+            result += QString("\\u%0").arg(c.unicode(), 4, 16, QLatin1Char('0'));
+        else
+            result += c;
+    }
+    return result;
+}
+
+bool TraceRecorder::save(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    QTextStream out(&file);
+    out.setCodec("UTF-8");
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    const char *separator = "";
+
+    QHash<Qt::HANDLE, int>::const_iterator it;
+    for (it = m_threads.constBegin(); it != m_threads.constEnd(); ++it) {
+        out << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << it.value()
+            << ",\"args\":{\"name\":\"" << (it.value() == m_mainThread ? "main" : "worker") << "\"}}";
+        separator = ",\n";
+    }
+
+    // begin and end are written as one complete event, which keeps the
+    // file at half the size of separate B and E events
+    foreach (const Event &event, m_events) {
+        out << separator << "{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category
+            << "\",\"ph\":\"X\",\"ts\":" << event.begin << ",\"dur\":" << event.duration
+            << ",\"pid\":1,\"tid\":" << event.thread;
+        if (event.detail >= 0)
+            out << ",\"args\":{\"detail\":\"" << escaped(m_details.at(event.detail)) << "\"}";
+        out << "}";
+        separator = ",\n";
+    }
+
+    out << "\n]}\n";
+    out.flush();
+
+    return file.error() == QFile::NoError;
+}
@@ -0,0 +1,132 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+// Records timed events from any thread and writes them as Chrome trace
+// event JSON, which chrome://tracing and Perfetto can open. Names and
+// categories must be string literals, they're stored as pointers.
+class TraceRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    static TraceRecorder *instance();
+
+    static bool isRecording() { return s_recording; }
+
+    // starts recording into the given file, written when recording stops
+    void start(const QString &fileName);
+
+    // the begin time of an event in microseconds since recording started
+    qint64 now() const { return m_clock.nsecsElapsed() / 1000; }
+    void addEvent(const char *name, const char *category, qint64 begin, qint64 end,
+                  const QString &detail = QString());
+
+    static QString defaultFileName();
+
+public slots:
+    void stop();
+
+private:
+    TraceRecorder();
+
+    bool save(const QString &fileName) const;
+
+    struct Event
+    {
+        const char *name;
+        const char *category;
+        qint64 begin;
+        qint64 duration;
+        int thread;
+        int detail;
+    };
+
+    enum { MaxEvents = 1 << 20 };
+
+    // written under m_mutex, read without it by every TraceScope
+    static QAtomicInt s_recording;
+
+    mutable QMutex m_mutex;
+    QElapsedTimer m_clock;
+    QString m_fileName;
+    QVector<Event> m_events;
+    QVector<QString> m_details;
+    QHash<Qt::HANDLE, int> m_threads;
+    int m_mainThread;
+    bool m_overflowed;
+};
+
+// Records an event covering the enclosing scope while tracing.
+class TraceScope
+{
+public:
+    TraceScope(const char *name, const char *category, const QString &detail = QString())
+        : m_name(name)
+        , m_category(category)
+        , m_active(TraceRecorder::isRecording())
+    {
+        if (m_active) {
+            m_detail = detail;
+            m_begin = TraceRecorder::instance()->now();
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (m_active) {
+            TraceRecorder *recorder = TraceRecorder::instance();
+            recorder->addEvent(m_name, m_category, m_begin, recorder->now(), m_detail);
+        }
+    }
+
+private:
+    const char *m_name;
+    const char *m_category;
+    bool m_active;
+    qint64 m_begin;
+    QString m_detail;
+};
+
+#endif
@@ -0,0 +1,125 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#include "visibilitypolygon.h"
+#include "tilemap.h"
+
+#include <QLineF>
+#include <QMap>
+#include <qmath.h>
+
+static inline qreal cross(const QPointF &a, const QPointF &b)
+{
+    return a.x() * b.y() - a.y() * b.x();
+}
+
+VisibilityPolygon::VisibilityPolygon(const QPointF &origin, const TileMap &map,
+                                     const QVector<QPointF> &corners, qreal range, bool doorsClosed)
+    : m_origin(origin)
+{
+    // rays just past each side of a corner find what lies behind it
+    const qreal epsilon = 1e-4;
+
+    QVector<qreal> angles;
+    foreach (const QPointF &corner, corners) {
+        const QPointF delta = corner - origin;
+        if (qAbs(delta.x()) > range || qAbs(delta.y()) > range)
+            continue;
+        const qreal angle = qAtan2(delta.y(), delta.x());
+        angles << angle - epsilon << angle << angle + epsilon;
+    }
+
+    // a few evenly spaced rays in case no corners are in range
+    const int fallbackRays = 16;
+    for (int i = 0; i < fallbackRays; ++i)
+        angles << (2 * M_PI * i) / fallbackRays - M_PI;
+
+    QMap<qreal, QPointF> vertices;
+    foreach (qreal angle, angles) {
+        if (angle < -M_PI)
+            angle += 2 * M_PI;
+        else if (angle >= M_PI)
+            angle -= 2 * M_PI;
+        vertices.insert(angle, cast(map, angle, doorsClosed));
+    }
+
+    m_angles.reserve(vertices.size());
+    m_vertices.reserve(vertices.size());
+    QMap<qreal, QPointF>::const_iterator it;
+    for (it = vertices.constBegin(); it != vertices.constEnd(); ++it) {
+        m_angles << it.key();
+        m_vertices << it.value();
+    }
+}
+
+// the point where a ray from the origin first enters a blocking cell
+QPointF VisibilityPolygon::cast(const TileMap &map, qreal angle, bool doorsClosed) const
+{
+    const QPointF direction(qCos(angle), qSin(angle));
+    const int blockingType = doorsClosed ? TileMap::Door : TileMap::Wall;
+
+    GridRay ray(m_origin, direction);
+    forever {
+        ray.next();
+        if (map.type(ray.x(), ray.y()) >= blockingType)
+            return m_origin + direction * ray.distance();
+    }
+}
+
+bool VisibilityPolygon::contains(const QPointF &pos) const
+{
+    if (isEmpty())
+        return true;
+
+    const QPointF delta = pos - m_origin;
+    const qreal angle = qAtan2(delta.y(), delta.x());
+
+    // the polygon edge spanning the angle, wrapping around at -pi
+    int j = qUpperBound(m_angles.constBegin(), m_angles.constEnd(), angle) - m_angles.constBegin();
+    if (j == m_angles.size())
+        j = 0;
+    const int i = (j == 0 ? m_angles.size() : j) - 1;
+
+    const QPointF a = m_vertices.at(i);
+    const QPointF edge = m_vertices.at(j) - a;
+
+    // inside if pos lies on the same side of the edge as the origin
+    const qreal side = cross(edge, pos - a);
+    const qreal originSide = cross(edge, m_origin - a);
+    if (qFuzzyIsNull(originSide)) {
+        const qreal length = qMax(QLineF(m_origin, a).length(), QLineF(m_origin, m_vertices.at(j)).length());
+        return QLineF(m_origin, pos).length() <= length;
+    }
+    return side * originSide >= 0;
+}
@@ -0,0 +1,71 @@
+/****************************************************************************
+
+This file is part of the wolfenqt project on http://qt.gitorious.org.
+
+Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).*
+All rights reserved.
+
+Contact:  Nokia Corporation (qt-info@nokia.com)**
+
+You may use this file under the terms of the BSD license as follows:
+
+"Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+* Neither the name of Nokia Corporation and its Subsidiary(-ies) nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE."
+
+****************************************************************************/
+#ifndef VISIBILITYPOLYGON_H
+#define VISIBILITYPOLYGON_H
+
+#include <QPointF>
+#include <QVector>
+
+class TileMap;
+
+// The part of the map visible from a point, as a polygon that is star
+// shaped around it. Built by casting rays through the tile grid towards
+// the wall corners around the point, so walls cast sharp 2D shadows.
+class VisibilityPolygon
+{
+public:
+    VisibilityPolygon() {}
+
+    // corners are the wall corners the rays are aimed at, only the ones
+    // within range of the origin are used, doors block when closed
+    VisibilityPolygon(const QPointF &origin, const TileMap &map,
+                      const QVector<QPointF> &corners, qreal range, bool doorsClosed);
+
+    QPointF origin() const { return m_origin; }
+    bool isEmpty() const { return m_vertices.size() < 3; }
+
+    // true if pos can be seen from the origin, an empty polygon sees all
+    bool contains(const QPointF &pos) const;
+
+private:
+    QPointF cast(const TileMap &map, qreal angle, bool doorsClosed) const;
+
+    QPointF m_origin;
+    // vertices in counter clockwise order along with their angles
+    QVector<qreal> m_angles;
+    QVector<QPointF> m_vertices;
+};
+
+#endif
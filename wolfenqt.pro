@@ -14,6 +14,7 @@ QT += webkit script
 contains(QT_CONFIG, opengl):{
 QT += opengl
 unix:!mac:!contains(QT_CONFIG, opengles2) LIBS += -lGLEW
+unix:!mac:!contains(QT_CONFIG, opengles2) DEFINES += USE_GL_RENDERER
 }
 
 contains(QT_CONFIG, phonon):{
@@ -36,8 +37,8 @@ DEPLOYMENT_PLUGIN += phonon_ds9 phonon_waveout
 }
 
 # Input
-HEADERS += entity.h mazescene.h scriptwidget.h
-SOURCES += main.cpp entity.cpp mazescene.cpp scriptwidget.cpp
+HEADERS += entity.h mazescene.h scriptwidget.h spanbuffer.h tilemap.h mapfile.h mazegenerator.h frameprofiler.h tracerecorder.h glrenderer.h columnrenderer.h floorrenderer.h lightgrid.h visibilitypolygon.h simulation.h framedriver.h fieldofview.h
+SOURCES += main.cpp entity.cpp mazescene.cpp scriptwidget.cpp spanbuffer.cpp tilemap.cpp mapfile.cpp mazegenerator.cpp frameprofiler.cpp tracerecorder.cpp glrenderer.cpp columnrenderer.cpp floorrenderer.cpp lightgrid.cpp visibilitypolygon.cpp simulation.cpp framedriver.cpp fieldofview.cpp
 
 # From modelviewer
 HEADERS += modelitem.h model.h